@@ -0,0 +1,10 @@
+#!/bin/sh
+set -e
+
+glslc ./shaders/shader.vert -o ./shaders/vert.spv
+glslc ./shaders/shader.frag -o ./shaders/frag.spv
+glslc ./shaders/cull.comp -o ./shaders/cull.spv
+glslc ./shaders/hiz.comp -o ./shaders/hiz.spv
+gcc main.c -DDEBUG -I"$(pkg-config --variable=includedir glfw3)/GLFW" -I./lib -I./lib/cglm/include $(pkg-config --libs glfw3 vulkan) -lm -lpthread -Wall -Wextra -o main
+gcc tools/texcook.c -I. -I./lib $(pkg-config --cflags vulkan) -lm -Wall -Wextra -o tools/texcook
+gcc tools/meshcook.c -I. -I./lib $(pkg-config --cflags vulkan) -lm -Wall -Wextra -o tools/meshcook
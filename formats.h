@@ -0,0 +1,276 @@
+#ifndef FORMATS_H
+#define FORMATS_H
+
+// asset formats shared by the renderer and the offline tools in tools/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include "vulkan/vulkan.h"
+
+
+// cooked texture (.ctex): a header, one CookedTextureLevel per mip level (largest first),
+// then the level data, each level starting on a COOKED_TEXTURE_ALIGNMENT boundary so it can be copied straight to the GPU
+#define COOKED_TEXTURE_MAGIC     0x58455443 // "CTEX"
+#define COOKED_TEXTURE_VERSION   1
+#define COOKED_TEXTURE_ALIGNMENT 16
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;    // VkFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+} CookedTextureHeader;
+
+typedef struct {
+    uint64_t offset;    // from the start of the file
+    uint64_t size;
+} CookedTextureLevel;
+
+
+static inline uint32_t mipLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    for (uint32_t size = width > height ? width : height; size > 1; size /= 2) levels++;
+    return levels;
+}
+
+static inline uint32_t mipExtent(uint32_t extent, uint32_t level)
+{
+    return extent >> level > 0 ? extent >> level : 1;
+}
+
+// bytes per 4x4 block, 0 for formats that aren't block compressed
+static inline uint32_t blockFormatSize(VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+            return 8;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+static inline uint64_t textureLevelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+    uint32_t blockSize = blockFormatSize(format);
+    if (blockSize == 0) return (uint64_t)width * height * 4;
+
+    return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+// checks that everything the header and level table claim lies inside the file
+static inline bool validateCookedTexture(const void *data, size_t size)
+{
+    if (size < sizeof(CookedTextureHeader)) return false;
+
+    CookedTextureHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != COOKED_TEXTURE_MAGIC || header.version != COOKED_TEXTURE_VERSION) return false;
+    if (header.width == 0 || header.height == 0 || header.mipLevels == 0 || header.mipLevels > mipLevelCount(header.width, header.height)) return false;
+    if (blockFormatSize(header.format) == 0 && header.format != VK_FORMAT_R8G8B8A8_SRGB && header.format != VK_FORMAT_R8G8B8A8_UNORM) return false;
+    if (size < sizeof(CookedTextureHeader) + header.mipLevels * sizeof(CookedTextureLevel)) return false;
+
+    const CookedTextureLevel *levels = (const CookedTextureLevel *)((const char *)data + sizeof(CookedTextureHeader));
+    for (uint32_t i = 0; i < header.mipLevels; i++)
+    {
+        CookedTextureLevel level;
+        memcpy(&level, &levels[i], sizeof(level));
+
+        if (level.offset % COOKED_TEXTURE_ALIGNMENT != 0 || level.offset > size || level.size > size - level.offset) return false;
+        if (level.size != textureLevelSize(header.format, mipExtent(header.width, i), mipExtent(header.height, i))) return false;
+    }
+
+    return true;
+}
+
+
+// mesh (.cmesh): a header, one MeshSubmesh per submesh, then the vertex and index data, each starting on a MESH_ALIGNMENT boundary
+// and laid out exactly as the vertex and index buffers expect it so loading is a copy
+#define MESH_MAGIC     0x4853454d // "MESH"
+#define MESH_VERSION   2
+#define MESH_ALIGNMENT 16
+
+// values are the vertex shader input locations, normals are always octahedral encoded into two components
+typedef enum {
+    VERTEX_ATTRIBUTE_POSITION,
+    VERTEX_ATTRIBUTE_COLOR,
+    VERTEX_ATTRIBUTE_TEXCOORD,
+    VERTEX_ATTRIBUTE_NORMAL,
+    VERTEX_ATTRIBUTE_COUNT
+} VertexAttribute;
+
+typedef struct {
+    uint32_t format;    // VkFormat, VK_FORMAT_UNDEFINED when the mesh doesn't have the attribute
+    uint32_t offset;    // within a vertex
+} MeshAttribute;
+
+typedef struct {
+    uint32_t      magic;
+    uint32_t      version;
+    uint32_t      vertexCount;
+    uint32_t      vertexStride;
+    MeshAttribute attributes[VERTEX_ATTRIBUTE_COUNT];
+    uint32_t      indexType;    // VkIndexType
+    uint32_t      indexCount;
+    uint32_t      submeshCount;
+    uint32_t      reserved;
+    // model space position = stored position * positionScale + positionBias, so positions can be stored normalized
+    float         positionScale[3];
+    float         positionBias[3];
+    uint64_t      vertexDataOffset;
+    uint64_t      indexDataOffset;
+} MeshHeader;
+
+// one vkCmdDrawIndexed worth of triangles, bounds are in model space
+typedef struct {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t  vertexOffset;
+    float    boundsMin[3];
+    float    boundsMax[3];
+} MeshSubmesh;
+
+
+// bytes taken by one vertex attribute, 0 for formats meshes can't use
+static inline uint32_t vertexFormatSize(VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_R8G8_SNORM:          return 2;
+        case VK_FORMAT_R8G8B8A8_UNORM:      return 4;
+        case VK_FORMAT_R16G16_UNORM:        return 4;
+        case VK_FORMAT_R16G16_SNORM:        return 4;
+        case VK_FORMAT_R16G16_SFLOAT:       return 4;
+        case VK_FORMAT_R16G16B16A16_SNORM:  return 8;
+        case VK_FORMAT_R16G16B16A16_SFLOAT: return 8;
+        case VK_FORMAT_R32G32_SFLOAT:       return 8;
+        case VK_FORMAT_R32G32B32_SFLOAT:    return 12;
+        case VK_FORMAT_R32G32B32A32_SFLOAT: return 16;
+        default:                            return 0;
+    }
+}
+
+static inline uint32_t indexTypeSize(VkIndexType indexType)
+{
+    switch (indexType)
+    {
+        case VK_INDEX_TYPE_UINT16: return 2;
+        case VK_INDEX_TYPE_UINT32: return 4;
+        default:                   return 0;
+    }
+}
+
+// checks the header, layout and submesh table against the file size, index values are trusted
+static inline bool validateMesh(const void *data, size_t size)
+{
+    if (size < sizeof(MeshHeader)) return false;
+
+    MeshHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != MESH_MAGIC || header.version != MESH_VERSION) return false;
+    if (header.vertexCount == 0 || header.vertexStride == 0 || header.indexCount == 0 || header.submeshCount == 0 || indexTypeSize(header.indexType) == 0) return false;
+    if (header.attributes[VERTEX_ATTRIBUTE_POSITION].format == VK_FORMAT_UNDEFINED) return false;
+
+    for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++)
+    {
+        MeshAttribute attribute = header.attributes[i];
+        if (attribute.format == VK_FORMAT_UNDEFINED) continue;
+
+        uint32_t attributeSize = vertexFormatSize(attribute.format);
+        if (attributeSize == 0 || attribute.offset > header.vertexStride || attributeSize > header.vertexStride - attribute.offset) return false;
+    }
+
+    if ((uint64_t)header.submeshCount * sizeof(MeshSubmesh) > size - sizeof(MeshHeader)) return false;
+
+    uint64_t vertexSize = (uint64_t)header.vertexCount * header.vertexStride;
+    uint64_t indexSize  = (uint64_t)header.indexCount * indexTypeSize(header.indexType);
+    if (header.vertexDataOffset % MESH_ALIGNMENT != 0 || header.vertexDataOffset > size || vertexSize > size - header.vertexDataOffset) return false;
+    if (header.indexDataOffset % MESH_ALIGNMENT != 0 || header.indexDataOffset > size || indexSize > size - header.indexDataOffset) return false;
+
+    const MeshSubmesh *submeshes = (const MeshSubmesh *)((const char *)data + sizeof(MeshHeader));
+    for (uint32_t i = 0; i < header.submeshCount; i++)
+    {
+        MeshSubmesh submesh;
+        memcpy(&submesh, &submeshes[i], sizeof(submesh));
+
+        if (submesh.firstIndex > header.indexCount || submesh.indexCount > header.indexCount - submesh.firstIndex) return false;
+        if (submesh.vertexOffset < 0 || (uint32_t)submesh.vertexOffset >= header.vertexCount) return false;
+    }
+
+    return true;
+}
+
+
+static float srgbToLinearTable[256];
+
+static inline float srgbToLinear(uint8_t value)
+{
+    if (srgbToLinearTable[255] == 0)
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            float x              = i / 255.0f;
+            srgbToLinearTable[i] = x <= 0.04045f ? x / 12.92f : powf((x + 0.055f) / 1.055f, 2.4f);
+        }
+    }
+
+    return srgbToLinearTable[value];
+}
+
+static inline uint8_t linearToSrgb(float value)
+{
+    float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+    return (uint8_t)(srgb * 255.0f + 0.5f);
+}
+
+// 2x2 box filter of RGBA8 texels, color averaged in linear space when srgb is set,
+// the last row and column of odd sized levels are clamped to rather than folded in
+static inline void downsampleRgba8(const uint8_t *src, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst, uint32_t dstWidth, uint32_t dstHeight, bool srgb)
+{
+    for (uint32_t y = 0; y < dstHeight; y++)
+    {
+        uint32_t y0 = y * 2 < srcHeight ? y * 2 : srcHeight - 1;
+        uint32_t y1 = y0 + 1 < srcHeight ? y0 + 1 : y0;
+
+        for (uint32_t x = 0; x < dstWidth; x++)
+        {
+            uint32_t x0 = x * 2 < srcWidth ? x * 2 : srcWidth - 1;
+            uint32_t x1 = x0 + 1 < srcWidth ? x0 + 1 : x0;
+
+            const uint8_t *texels[4] = {
+                &src[(y0 * srcWidth + x0) * 4], &src[(y0 * srcWidth + x1) * 4],
+                &src[(y1 * srcWidth + x0) * 4], &src[(y1 * srcWidth + x1) * 4]
+            };
+
+            uint8_t *out = &dst[(y * dstWidth + x) * 4];
+            for (int c = 0; c < 4; c++)
+            {
+                if (srgb && c < 3) out[c] = linearToSrgb(0.25f * (srgbToLinear(texels[0][c]) + srgbToLinear(texels[1][c]) + srgbToLinear(texels[2][c]) + srgbToLinear(texels[3][c])));
+                else out[c] = (texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4;
+            }
+        }
+    }
+}
+
+#endif
@@ -5,6 +5,22 @@
 #include <string.h>
 #include <limits.h>
 #include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+    // NOGDI keeps wingdi.h from defining ERROR
+    #define WIN32_LEAN_AND_MEAN
+    #define NOGDI
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 #include "vulkan/vulkan.h"
 #include "vulkan/vk_enum_string_helper.h"
@@ -19,6 +35,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "formats.h"
+
 
 #define QFI_GRAPHICS_BIT 0b01
 #define QFI_PRESENT_BIT  0b10
@@ -26,6 +44,8 @@
 
 #define ARR_LEN(array) (sizeof((array))/sizeof((array)[0]))
 
+#define ALIGN_UP(value, alignment) (((value) + (alignment) - 1) / (alignment) * (alignment))
+
 #define FATAL(...) do \
 { \
     fprintf(stderr, "\e[1;31mFATAL:\e[0m " __VA_ARGS__); \
@@ -50,20 +70,15 @@
     if (result != VK_SUCCESS) fail; \
 } while (0)
 
-#define bufalloc(buffer, newCount) do \
-{ \
-    if ((buffer)->count < (newCount)) \
-    { \
-        if ((buffer)->data != NULL) free((buffer)->data); \
-        (buffer)->count = (newCount); \
-        (buffer)->data  = malloc((newCount)); \
-    } \
-} while (0)
-
+// a read-only view of a whole file, mapped rather than copied, so data is page aligned
 typedef struct {
-    uint32_t count;
-    char *data;
-} ByteBuf;
+    const void *data;
+    size_t      size;
+#ifdef _WIN32
+    HANDLE      file;
+    HANDLE      mapping;
+#endif
+} AssetView;
 
 
 int clamp(int x, int min, int max)
@@ -72,27 +87,279 @@ int clamp(int x, int min, int max)
     return y > max ? max : y;
 }
 
-// FIXME: make this not sketchy and handle errors
-ByteBuf readFile(const char *path)
+#ifdef _WIN32
+bool mapAsset(const char *path, AssetView *view)
 {
-    FILE *file = fopen(path, "rb");
-    fseek(file, 0, SEEK_END);
-    uint32_t size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    *view = (AssetView){ 0 };
 
-    ByteBuf buffer = { 0 };
-    bufalloc(&buffer, size);
-    fread(buffer.data, size, 1, file);
-    fclose(file);
+    view->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (view->file == INVALID_HANDLE_VALUE)
+    {
+        ERROR("could not open %s: error %lu\n", path, GetLastError());
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(view->file, &size))
+    {
+        ERROR("could not get size of %s: error %lu\n", path, GetLastError());
+        CloseHandle(view->file);
+        return false;
+    }
+
+    view->size = size.QuadPart;
+    // empty files can't be mapped, an empty view is still valid
+    if (view->size == 0) return true;
+
+    view->mapping = CreateFileMappingA(view->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (view->mapping != NULL) view->data = MapViewOfFile(view->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view->data == NULL)
+    {
+        ERROR("could not map %s: error %lu\n", path, GetLastError());
+        if (view->mapping != NULL) CloseHandle(view->mapping);
+        CloseHandle(view->file);
+        return false;
+    }
+
+    return true;
+}
+
+void unmapAsset(AssetView *view)
+{
+    if (view->data != NULL) UnmapViewOfFile(view->data);
+    if (view->mapping != NULL) CloseHandle(view->mapping);
+    if (view->file != NULL) CloseHandle(view->file);
+    *view = (AssetView){ 0 };
+}
+#else
+bool mapAsset(const char *path, AssetView *view)
+{
+    *view = (AssetView){ 0 };
+
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        ERROR("could not open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0)
+    {
+        ERROR("could not stat %s: %s\n", path, strerror(errno));
+        close(file);
+        return false;
+    }
+
+    view->size = info.st_size;
+    if (view->size == 0)
+    {
+        close(file);
+        return true;
+    }
+
+    // the mapping outlives the descriptor
+    void *data = mmap(NULL, view->size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
 
-    return buffer;
+    if (data == MAP_FAILED)
+    {
+        ERROR("could not map %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    view->data = data;
+    return true;
+}
+
+void unmapAsset(AssetView *view)
+{
+    if (view->data != NULL) munmap((void *)view->data, view->size);
+    *view = (AssetView){ 0 };
+}
+#endif
+
+static inline double getTime(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + 1.0e-9 * time.tv_nsec;
 }
 
 typedef struct {
     vec3 pos;
     vec3 color;
+    vec2 texCoord;
+    vec2 normal;    // octahedral
 } Vertex;
 
+#define MEMORY_BLOCK_SIZE (64 * 1024 * 1024)
+#define STAGING_RING_SIZE (64 * 1024 * 1024)
+#define UPLOAD_BATCHES    4
+
+typedef struct {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} MemoryRange;
+
+typedef struct {
+    VkDeviceMemory  memory;
+    uint32_t        memoryType;
+    VkDeviceSize    size;
+    VkDeviceSize    used;
+    void           *mapped;
+    MemoryRange    *freeRanges;
+    uint32_t        allocationCount;
+    bool            linear;
+    bool            dedicated;
+} MemoryBlock;
+
+typedef struct {
+    MemoryBlock    *block;
+    VkDeviceMemory  memory;
+    VkDeviceSize    offset;
+    VkDeviceSize    size;
+    void           *mapped;
+} Allocation;
+
+typedef struct {
+    VkImage     image;
+    Allocation  allocation;
+    VkImageView view;
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    mipLevels;
+} Texture;
+
+typedef struct {
+    VkBuffer     vertexBuffer;
+    Allocation   vertexAllocation;
+    VkBuffer     indexBuffer;
+    Allocation   indexAllocation;
+    VkIndexType  indexType;
+    MeshSubmesh *submeshes;
+    uint32_t     vertexStride;
+    MeshAttribute attributes[VERTEX_ATTRIBUTE_COUNT];
+    vec3         positionScale;
+    vec3         positionBias;
+} Mesh;
+
+// per instance vertex data, read through an instance rate binding right after the mesh's attributes
+typedef struct {
+    mat4 model;
+} Instance;
+
+#define INSTANCE_BINDING  1
+#define INSTANCE_LOCATION VERTEX_ATTRIBUTE_COUNT
+
+// culling runs as compute passes around the render pass, compacting the instances of each draw that survive
+// into that draw's range of the frame's culled instance buffer, which the draw commands then read in place of the instance buffer:
+// the early phase tests against the frustum and the depth pyramid of the previous frame and draws what passes,
+// the late phase retests what the early one found occluded against a pyramid of the early draws' depth, drawing what is visible after all
+typedef enum {
+    CULL_PHASE_EARLY,
+    CULL_PHASE_LATE,
+    CULL_PHASE_COUNT
+} CullPhase;
+
+typedef struct {
+    // both phases' draws and instance ranges, the late phase's after the early one's
+    VkBuffer        draws;
+    Allocation      drawsAllocation;
+    VkBuffer        instances;
+    Allocation      instancesAllocation;
+    // one flag per instance of each draw, set by the early phase for the late phase to retest
+    VkBuffer        occluded;
+    Allocation      occludedAllocation;
+    // host visible, read back once the frame's fence is signalled
+    VkBuffer        stats;
+    Allocation      statsAllocation;
+    VkDescriptorSet descriptorSet;
+} CullFrame;
+
+typedef struct {
+    uint32_t visible;
+    uint32_t occluded;
+} CullStats;
+
+typedef struct {
+    uint32_t instanceCapacity;
+    uint32_t drawCount;
+    uint32_t phase;
+    uint32_t occlusion;
+    uint32_t pyramidSize[2];
+    uint32_t pyramidLevels;
+    uint32_t reverseZ;
+} CullConstants;
+
+typedef struct {
+    int32_t sourceSize[2];
+    int32_t destinationSize[2];
+    int32_t reverseZ;
+} PyramidConstants;
+
+#define PYRAMID_WORKGROUP_SIZE 8
+
+#define CULL_WORKGROUP_SIZE 64
+
+// pushed per mesh, turns stored positions back into model space
+typedef struct {
+    vec4 positionScale;
+    vec4 positionBias;
+} MeshConstants;
+
+// one image handed to the decode workers, filled in by whichever worker picks it up
+typedef struct {
+    const char *path;
+    stbi_uc    *pixels;
+    // cooked textures skip decoding, their mapping is kept until the upload copies it
+    AssetView   cooked;
+    int         width;
+    int         height;
+    size_t      fileSize;
+    double      decodeTime;
+} TextureDecode;
+
+typedef struct {
+    TextureDecode  *decodes;
+    uint32_t        count;
+    uint32_t        next;
+    uint32_t       *finished;
+    pthread_mutex_t mutex;
+    pthread_cond_t  decoded;
+} TextureLoader;
+
+typedef struct {
+    VkCommandBuffer commandBuffer;
+    VkSemaphore     semaphore;
+    VkFence         fence;
+    uint64_t        token;
+    bool            recording;
+    bool            timed;
+} UploadBatch;
+
+typedef struct {
+    uint32_t        familyIndex;
+    VkQueue         queue;
+    VkCommandPool   commandPool;
+    UploadBatch     batches[UPLOAD_BATCHES];
+    uint32_t        current;
+    uint64_t        nextToken;
+    uint64_t        submittedToken;
+    uint64_t        completedToken;
+    VkSemaphore    *pendingSemaphores;
+    VkQueryPool     queryPool;
+    uint64_t        timestampMask;
+    // partial image copies have to start and end on multiples of this, zero means whole levels only
+    VkExtent3D      transferGranularity;
+} UploadQueue;
+
+typedef struct {
+    UploadQueue    *queue;
+    uint64_t        token;
+    VkDeviceSize    end;
+} StagingRegion;
+
 typedef struct {
     CGLM_ALIGN_MAT mat4 model;
     CGLM_ALIGN_MAT mat4 view;
@@ -100,11 +367,129 @@ typedef struct {
 } UniformBufferObject;
 
 
+typedef struct {
+    bool        headless;
+    uint32_t    frames;
+    uint32_t    width;
+    uint32_t    height;
+    const char *outputPath;
+    bool        hash;
+    const char *benchmarkPath;
+    uint32_t    warmup;
+    double      duration;
+    bool        recordEveryFrame;
+    uint32_t    framesInFlight;
+    uint32_t    swapchainImages;
+    VkPresentModeKHR presentMode;
+    double      fpsCap;
+    bool        waitBeforeRecord;
+    const char **texturePaths;
+    uint32_t    loaderThreads;
+    const char *meshPath;
+    uint32_t    instances;
+    bool        noCull;
+    bool        reverseZ;
+} Options;
+
+// prepended to the driver's cache blob, the blob's own header has no driver version
+typedef struct {
+    uint32_t magic;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+} PipelineCacheHeader;
+
+typedef struct {
+    double frame;
+    double fenceWait;
+    double pacing;
+    double acquire;
+    double record;
+    double submit;
+    double present;
+    double latency;
+    double gpuRenderPass;
+    double gpuDraw;
+    double gpuUpload;
+    double gpuCull;
+    double gpuDepthPyramid;
+    double gpuLateCull;
+    double gpuLateDraw;
+    // not timings, read back from the slot's previous frame like the GPU scopes
+    uint32_t visibleInstances;
+    uint32_t occludedInstances;
+} FrameTiming;
+
+typedef enum {
+    DELETION_SWAPCHAIN,
+    DELETION_IMAGE_VIEW,
+    DELETION_FRAMEBUFFER,
+    DELETION_BUFFER,
+    DELETION_IMAGE,
+    DELETION_PIPELINE,
+    DELETION_PIPELINE_LAYOUT,
+    DELETION_DESCRIPTOR_POOL
+} DeletionType;
+
+// a handle that may still be referenced by submitted work, destroyed once `retireAfter` completes:
+// a frame serial, or an upload token of `queue` when that is set
+typedef struct {
+    DeletionType     type;
+    uint64_t         retireAfter;
+    UploadQueue     *queue;
+    union {
+        VkSwapchainKHR   swapchain;
+        VkImageView      imageView;
+        VkFramebuffer    framebuffer;
+        VkPipeline       pipeline;
+        VkPipelineLayout pipelineLayout;
+        VkDescriptorPool descriptorPool;
+        struct {
+            VkBuffer   handle;
+            Allocation allocation;
+        } buffer;
+        struct {
+            VkImage    handle;
+            Allocation allocation;
+        } image;
+    };
+} Deletion;
+
+typedef enum {
+    GPU_SCOPE_RENDER_PASS,
+    GPU_SCOPE_DRAW,
+    GPU_SCOPE_CULL,
+    GPU_SCOPE_DEPTH_PYRAMID,
+    GPU_SCOPE_LATE_CULL,
+    GPU_SCOPE_LATE_DRAW,
+    GPU_SCOPE_COUNT
+} GpuScope;
+
+
 #define TITLE            "Vulkan test"
 #define WINDOW_WIDTH     800
 #define WINDOW_HEIGHT    600
 
-#define FRAMES_IN_FLIGHT 2
+#define FRAMES_IN_FLIGHT     2
+#define MAX_FRAMES_IN_FLIGHT 16
+
+#define HEADLESS_FORMAT  VK_FORMAT_R8G8B8A8_SRGB
+#define FIXED_TIMESTEP   (1.0 / 60.0)
+
+#define CAMERA_NEAR      0.1f
+#define CAMERA_FAR       10.0f
+
+#define BENCHMARK_WARMUP 30
+
+// the last stretch before a paced frame is spun instead of slept, sleeps overshoot by about this much
+#define PACING_SPIN_TIME (0.002)
+
+#define PIPELINE_CACHE_PATH  "./pipeline.cache"
+#define PIPELINE_CACHE_MAGIC 0x48435056 // "VPCH"
+
+#define SPIRV_MAGIC          0x07230203
 
 
 // TODO: support more validation layers
@@ -116,16 +501,33 @@ const char              *deviceExtensions[]    = {
 const uint32_t           deviceExtensionsCount = ARR_LEN(deviceExtensions);
 
 const Vertex vertices[] = {
-    {{ -0.5f, -0.5f, 0.0f }, { 1.0f, 0.0f, 0.0f }},
-    {{  0.5f, -0.5f, 0.0f }, { 0.0f, 1.0f, 0.0f }},
-    {{  0.5f,  0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f }},
-    {{ -0.5f,  0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }}
+    {{ -0.5f, -0.5f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.0f, 0.0f }},
+    {{  0.5f, -0.5f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f }, { 0.0f, 0.0f }},
+    {{  0.5f,  0.5f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f }, { 0.0f, 0.0f }},
+    {{ -0.5f,  0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 0.0f }}
 };
 
 const uint16_t indices[] = {
     0, 1, 2, 2, 3, 0
 };
 
+// the built-in quad is stored unquantized
+const MeshAttribute vertexLayout[VERTEX_ATTRIBUTE_COUNT] = {
+    [VERTEX_ATTRIBUTE_POSITION] = { VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos) },
+    [VERTEX_ATTRIBUTE_COLOR]    = { VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color) },
+    [VERTEX_ATTRIBUTE_TEXCOORD] = { VK_FORMAT_R32G32_SFLOAT,    offsetof(Vertex, texCoord) },
+    [VERTEX_ATTRIBUTE_NORMAL]   = { VK_FORMAT_R32G32_SFLOAT,    offsetof(Vertex, normal) }
+};
+
+const char              *vertexAttributeNames[VERTEX_ATTRIBUTE_COUNT] = {
+    [VERTEX_ATTRIBUTE_POSITION] = "position",
+    [VERTEX_ATTRIBUTE_COLOR]    = "color",
+    [VERTEX_ATTRIBUTE_TEXCOORD] = "texture coordinate",
+    [VERTEX_ATTRIBUTE_NORMAL]   = "normal"
+};
+
+
+Options                  options               = { .width = WINDOW_WIDTH, .height = WINDOW_HEIGHT, .warmup = BENCHMARK_WARMUP, .framesInFlight = FRAMES_IN_FLIGHT, .presentMode = VK_PRESENT_MODE_MAILBOX_KHR, .instances = 1 };
 
 GLFWwindow              *window;
 
@@ -134,65 +536,325 @@ VkInstance               instance;
 VkSurfaceKHR             surface;
 
 VkPhysicalDevice         physicalDevice        = VK_NULL_HANDLE;
+VkPhysicalDeviceProperties physicalDeviceProperties;
 uint32_t                 graphicsFamilyIndex   = 0;
 uint32_t                 presentFamilyIndex    = 0;
+uint32_t                 transferFamilyIndex   = 0;
 VkSurfaceCapabilitiesKHR swapCapabilities;
 VkPresentModeKHR        *swapPresentModes      = NULL;
+VkPresentModeKHR         swapPresentMode       = VK_PRESENT_MODE_FIFO_KHR;
 VkSurfaceFormatKHR      *swapFormats           = NULL;
 
 VkDevice                 device;
+VkPhysicalDeviceMemoryProperties memoryProperties;
+uint32_t                 maxMemoryAllocationCount;
+uint32_t                 memoryAllocationCount = 0;
+MemoryBlock            **memoryBlocks[VK_MAX_MEMORY_TYPES];
 VkQueue                  graphicsQueue;
 VkQueue                  presentQueue;
 
-VkSwapchainKHR           swapchain;
+VkSwapchainKHR           swapchain             = VK_NULL_HANDLE;
 VkFormat                 swapchainImageFormat;
 VkExtent2D               swapchainExtent;
 VkImage                 *swapchainImages       = NULL;
 
+Allocation              *offscreenAllocations  = NULL;
+VkBuffer                 readbackBuffer        = VK_NULL_HANDLE;
+Allocation               readbackAllocation;
+
 VkImageView             *swapchainImageViews   = NULL;
 
 VkRenderPass             renderPass;
+// continues the frame after the late cull phase, compatible with renderPass so they share framebuffers and pipelines
+VkRenderPass             lateRenderPass        = VK_NULL_HANDLE;
+
+VkFormat                 depthFormat           = VK_FORMAT_UNDEFINED;
+VkImage                  depthImage;
+Allocation               depthImageAllocation;
+VkImageView              depthImageView;
+
+// level 0 is a copy of the depth buffer after the early draws, every level above holds the farthest depth below it,
+// created with the depth buffer when culling is enabled
+VkImage                  depthPyramid;
+Allocation               depthPyramidAllocation;
+VkImageView              depthPyramidView;
+VkImageView             *depthPyramidLevelViews = NULL;
+uint32_t                 depthPyramidLevels    = 0;
+// cleared when the pyramid is recreated, the early phase skips the occlusion test until it has been built again
+bool                     depthPyramidValid     = false;
 
 VkDescriptorSetLayout    descriptorSetLayout;
 
 VkPipelineLayout         pipelineLayout;
 VkPipeline               graphicsPipeline;
+VkPipelineCache          pipelineCache;
 
 VkFramebuffer           *swapchainFramebuffers = NULL;
 
 VkCommandPool            commandPool;
 
-VkCommandBuffer          commandBuffers[FRAMES_IN_FLIGHT];
-
-VkImage                  textureImage;
-VkDeviceMemory           textureImageMemory;
-
-VkBuffer                 vertexBuffer;
-VkDeviceMemory           vertexBufferMemory;
-
-VkBuffer                 indexBuffer;
-VkDeviceMemory           indexBufferMemory;
+// all per frame arrays hold options.framesInFlight entries
+VkCommandBuffer         *commandBuffers        = NULL;
+// secondaries holding everything inside the render pass, one per cull phase, only re-recorded when what they reference changes
+VkCommandBuffer         *drawCommandBuffers    = NULL;
+bool                    *drawCommandsValid     = NULL;
+
+VkBuffer                 stagingRingBuffer;
+Allocation               stagingRingAllocation;
+VkDeviceSize             stagingRingHead       = 0;
+VkDeviceSize             stagingRingTail       = 0;
+StagingRegion           *stagingRegions        = NULL;
+
+UploadQueue              transferUploads;
+// blits need a graphics queue, so mip generation is recorded here
+UploadQueue              graphicsUploads;
+
+Texture                 *textures              = NULL;
+VkSampler                textureSampler;
+
+Mesh                     mesh;
+
+// every instance draws the whole mesh, so adding instances costs buffer space rather than draws
+Instance                *instances             = NULL;
+VkBuffer                 instanceBuffer;
+Allocation               instanceBufferAllocation;
+// instances are dealt round-robin into one group per texture, each group stored contiguously and drawn with that texture bound
+uint32_t                 instanceGroups        = 1;
+// instances in the largest group, the size of each draw's range of culled instances
+uint32_t                 instanceGroupCapacity = 0;
+
+// one indirect draw per submesh for each instance group, read by the GPU from the frame's indirect buffer, so changing a draw is a buffer write
+// while the recorded draw commands stay valid
+VkDrawIndexedIndirectCommand *drawList         = NULL;
+uint32_t                 drawInstanceCount     = 0;
+// per frame in flight, set when drawList changed since it was last copied into that frame's indirect buffer
+bool                    *drawListDirty         = NULL;
+VkBuffer                *indirectBuffers       = NULL;
+Allocation              *indirectBufferAllocations = NULL;
+bool                     multiDrawIndirect     = false;
+// model space bounding sphere per draw, radius in w
+VkBuffer                 drawBoundsBuffer;
+Allocation               drawBoundsAllocation;
+
+bool                     cullingEnabled        = false;
+CullFrame               *cullFrames            = NULL;
+VkDescriptorSetLayout    cullDescriptorSetLayout;
+// holds the cull and depth pyramid sets, recreated with the depth pyramid they reference
+VkDescriptorPool         cullDescriptorPool;
+VkPipelineLayout         cullPipelineLayout;
+VkPipeline               cullPipeline;
+VkSampler                depthPyramidSampler;
+VkDescriptorSetLayout    depthPyramidDescriptorSetLayout;
+VkDescriptorSet         *depthPyramidDescriptorSets = NULL;
+VkPipelineLayout         depthPyramidPipelineLayout;
+VkPipeline               depthPyramidPipeline;
 
 // TODO: merge
-VkBuffer                 uniformBuffers[FRAMES_IN_FLIGHT];
-VkDeviceMemory           uniformBufferMemories[FRAMES_IN_FLIGHT];
-void                    *mappedUniformBuffers[FRAMES_IN_FLIGHT];
+VkBuffer                *uniformBuffers        = NULL;
+Allocation              *uniformBufferAllocations = NULL;
 
 VkDescriptorPool         descriptorPool;
 
-VkDescriptorSet          descriptorSets[FRAMES_IN_FLIGHT];
+VkDescriptorSet         *descriptorSets        = NULL;
 
-VkSemaphore              imageAvailableSemaphores[FRAMES_IN_FLIGHT];
-VkSemaphore              renderFinishedSemaphores[FRAMES_IN_FLIGHT];
-VkFence                  inFlightFences[FRAMES_IN_FLIGHT];
+VkSemaphore             *imageAvailableSemaphores = NULL;
+VkSemaphore             *renderFinishedSemaphores = NULL;
+VkFence                 *inFlightFences        = NULL;
+double                  *frameStartTimes       = NULL;
+// serial + 1 of the frame last submitted from each slot, frames below completedFrames are done on the GPU
+uint64_t                *frameSerials          = NULL;
+uint64_t                 completedFrames       = 0;
+Deletion                *deletionQueue         = NULL;
 
-uint8_t                  currentFrame          = 0;
+uint32_t                 currentFrame          = 0;
+uint64_t                 frameNumber           = 0;
 bool                     framebufferResized    = false;
+bool                     pipelineReloadRequested = false;
+uint32_t                 requestedInstanceCount = 0;
 
-// TODO: investtigate more accurate / better FPS measuring methods (prolly no longer necessary though)
-struct timespec          lastFrameEnd;
+double                   runStart              = 0;
+double                   lastFrameEnd          = 0;
+double                   nextFrameTime         = 0;
 double                   deltaTime             = 0;
 
+// on the model's axis of rotation, so instances keep their distance to it as the model spins
+vec3                     cameraEye             = { 0.0f, 0.0f, 2.0f };
+
+VkQueryPool              timestampQueryPool    = VK_NULL_HANDLE;
+uint64_t                 timestampMask         = 0;
+bool                    *timestampsWritten     = NULL;
+double                   uploadGpuTime         = 0;
+
+FrameTiming             *frameTimings          = NULL;
+double                   benchmarkStart        = 0;
+
+
+static const struct {
+    const char      *name;
+    VkPresentModeKHR mode;
+    // tried in order when the requested mode isn't supported, FIFO is always available
+    VkPresentModeKHR fallbacks[3];
+} presentModes[] = {
+    { "immediate",    VK_PRESENT_MODE_IMMEDIATE_KHR,    { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR } },
+    { "mailbox",      VK_PRESENT_MODE_MAILBOX_KHR,      { VK_PRESENT_MODE_FIFO_KHR,    VK_PRESENT_MODE_FIFO_KHR,         VK_PRESENT_MODE_FIFO_KHR } },
+    { "fifo-relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR, { VK_PRESENT_MODE_FIFO_KHR,    VK_PRESENT_MODE_FIFO_KHR,         VK_PRESENT_MODE_FIFO_KHR } },
+    { "fifo",         VK_PRESENT_MODE_FIFO_KHR,         { VK_PRESENT_MODE_FIFO_KHR,    VK_PRESENT_MODE_FIFO_KHR,         VK_PRESENT_MODE_FIFO_KHR } },
+};
+
+static bool parsePresentMode(const char *name, VkPresentModeKHR *mode)
+{
+    for (size_t i = 0; i < ARR_LEN(presentModes); i++)
+    {
+        if (strcmp(name, presentModes[i].name) != 0) continue;
+
+        *mode = presentModes[i].mode;
+        return true;
+    }
+
+    return false;
+}
+
+static const char *presentModeName(VkPresentModeKHR mode)
+{
+    for (size_t i = 0; i < ARR_LEN(presentModes); i++)
+    {
+        if (presentModes[i].mode == mode) return presentModes[i].name;
+    }
+
+    return "unknown";
+}
+
+
+static void usage(const char *program)
+{
+    LOG("usage: %s [options]\n", program);
+    LOG("    --headless          render offscreen without a window, surface or swapchain\n");
+    LOG("    --frames <n>        exit after rendering n frames, not counting warm-up (headless default: 1)\n");
+    LOG("    --size <w>x<h>      offscreen render target size (default: %dx%d)\n", WINDOW_WIDTH, WINDOW_HEIGHT);
+    LOG("    --output <file.ppm> write the last headless frame to a PPM image\n");
+    LOG("    --hash              print a hash of the last headless frame\n");
+    LOG("    --benchmark <file>  record frame timings and write percentiles to a .json or .csv file\n");
+    LOG("    --warmup <n>        frames excluded from the benchmark (default: %d)\n", BENCHMARK_WARMUP);
+    LOG("    --duration <s>      exit after s seconds, counted from the first benchmarked frame with --benchmark\n");
+    LOG("    --record-every-frame re-record draw commands every frame instead of reusing them\n");
+    LOG("    --frames-in-flight <n> frames the CPU may run ahead of the GPU (default: %d)\n", FRAMES_IN_FLIGHT);
+    LOG("    --swapchain-images <n> requested swapchain image count (default: minimum + 1)\n");
+    LOG("    --present-mode <m>  immediate, mailbox, fifo or fifo-relaxed, falling back towards fifo (default: mailbox)\n");
+    LOG("    --fps-cap <hz>      pace frames on the CPU to at most hz frames per second\n");
+    LOG("    --wait-before-record wait for the previous frame to finish before sampling input and recording\n");
+    LOG("    --texture <path>    load a texture or cooked .ctex, may be repeated to spread instances over the textures (default: ./assets/texture.jpg)\n");
+    LOG("    --loader-threads <n> texture decode threads (default: one per CPU)\n");
+    LOG("    --mesh <path>       draw a .cmesh made by tools/meshcook instead of the built-in quad\n");
+    LOG("    --instances <n>     draw n copies of the mesh on a grid with one instanced draw per submesh (default: 1),\n");
+    LOG("                        = and - double and halve how many of them are drawn\n");
+    LOG("    --no-cull           draw every instance instead of frustum and occlusion culling them in compute passes first\n");
+    LOG("    --reverse-z         map the far plane to depth 0 and the near plane to 1 for better float depth precision\n");
+}
+
+static void parseOptions(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg   = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--headless") == 0) options.headless = true;
+        else if (strcmp(arg, "--hash") == 0) options.hash = true;
+        else if (strcmp(arg, "--record-every-frame") == 0) options.recordEveryFrame = true;
+        else if (strcmp(arg, "--no-cull") == 0) options.noCull = true;
+        else if (strcmp(arg, "--reverse-z") == 0) options.reverseZ = true;
+        else if (strcmp(arg, "--frames") == 0 && value != NULL)
+        {
+            options.frames = strtoul(value, NULL, 10);
+            i++;
+        }
+        else if (strcmp(arg, "--size") == 0 && value != NULL)
+        {
+            if (sscanf(value, "%ux%u", &options.width, &options.height) != 2 || options.width == 0 || options.height == 0) FATAL("invalid size: %s\n", value);
+            i++;
+        }
+        else if (strcmp(arg, "--output") == 0 && value != NULL)
+        {
+            options.outputPath = value;
+            i++;
+        }
+        else if (strcmp(arg, "--benchmark") == 0 && value != NULL)
+        {
+            options.benchmarkPath = value;
+            i++;
+        }
+        else if (strcmp(arg, "--warmup") == 0 && value != NULL)
+        {
+            options.warmup = strtoul(value, NULL, 10);
+            i++;
+        }
+        else if (strcmp(arg, "--duration") == 0 && value != NULL)
+        {
+            options.duration = strtod(value, NULL);
+            i++;
+        }
+        else if (strcmp(arg, "--frames-in-flight") == 0 && value != NULL)
+        {
+            options.framesInFlight = strtoul(value, NULL, 10);
+            if (options.framesInFlight == 0 || options.framesInFlight > MAX_FRAMES_IN_FLIGHT) FATAL("frames in flight must be between 1 and %d\n", MAX_FRAMES_IN_FLIGHT);
+            i++;
+        }
+        else if (strcmp(arg, "--swapchain-images") == 0 && value != NULL)
+        {
+            options.swapchainImages = strtoul(value, NULL, 10);
+            i++;
+        }
+        else if (strcmp(arg, "--present-mode") == 0 && value != NULL)
+        {
+            if (!parsePresentMode(value, &options.presentMode)) FATAL("unknown present mode: %s\n", value);
+            i++;
+        }
+        else if (strcmp(arg, "--fps-cap") == 0 && value != NULL)
+        {
+            options.fpsCap = strtod(value, NULL);
+            i++;
+        }
+        else if (strcmp(arg, "--wait-before-record") == 0) options.waitBeforeRecord = true;
+        else if (strcmp(arg, "--texture") == 0 && value != NULL)
+        {
+            arrput(options.texturePaths, value);
+            i++;
+        }
+        else if (strcmp(arg, "--loader-threads") == 0 && value != NULL)
+        {
+            options.loaderThreads = strtoul(value, NULL, 10);
+            i++;
+        }
+        else if (strcmp(arg, "--mesh") == 0 && value != NULL)
+        {
+            options.meshPath = value;
+            i++;
+        }
+        else if (strcmp(arg, "--instances") == 0 && value != NULL)
+        {
+            options.instances = strtoul(value, NULL, 10);
+            if (options.instances == 0) FATAL("invalid instance count: %s\n", value);
+            i++;
+        }
+        else if (strcmp(arg, "--help") == 0)
+        {
+            usage(argv[0]);
+            exit(0);
+        }
+        else
+        {
+            usage(argv[0]);
+            FATAL("unknown or incomplete option: %s\n", arg);
+        }
+    }
+
+    if (!options.headless && (options.outputPath != NULL || options.hash)) WARN("--output and --hash only apply to --headless\n");
+    if (options.headless && options.frames == 0 && options.duration == 0) options.frames = 1;
+    if (options.benchmarkPath == NULL) options.warmup = 0;
+    if (options.frames != 0) options.frames += options.warmup;
+    if (arrlen(options.texturePaths) == 0) arrput(options.texturePaths, "./assets/texture.jpg");
+}
+
 
 // TODO: keep drawing the window while resizing?
 static void framebufferResizeCallback(GLFWwindow *window, int width, int height)
@@ -204,6 +866,17 @@ static void framebufferResizeCallback(GLFWwindow *window, int width, int height)
     framebufferResized = true;
 }
 
+static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    (void) window;
+    (void) scancode;
+    (void) mods;
+
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS) pipelineReloadRequested = true;
+    if (key == GLFW_KEY_EQUAL && action == GLFW_PRESS) requestedInstanceCount = drawInstanceCount * 2;
+    if (key == GLFW_KEY_MINUS && action == GLFW_PRESS) requestedInstanceCount = drawInstanceCount / 2;
+}
+
 static inline void createWindow(void)
 {
     glfwInit();
@@ -212,6 +885,7 @@ static inline void createWindow(void)
 
     window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, TITLE, NULL, NULL);
     glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+    glfwSetKeyCallback(window, keyCallback);
 }
 
 
@@ -253,7 +927,7 @@ static inline void enableValidationLayers(VkInstanceCreateInfo *createInfo)
 static inline void createVulkanInstance(void)
 {
     uint32_t glfwExtensionsCount = 0;
-    const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionsCount);
+    const char **glfwExtensions = options.headless ? NULL : glfwGetRequiredInstanceExtensions(&glfwExtensionsCount);
 
     VkApplicationInfo appInfo          = { 0 };
     appInfo.sType                      = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -299,14 +973,25 @@ static inline bool checkQueueFamilies(VkPhysicalDevice device, VkQueueFamilyProp
     arrsetlen(queueFamilies, queueFamiliesCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamiliesCount, queueFamilies);
 
+    // a transfer-only family is usually a dedicated DMA engine, prefer the one without compute
+    transferFamilyIndex = UINT32_MAX;
+    for (uint32_t i = 0; i < queueFamiliesCount; i++)
+    {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) continue;
+
+        if (transferFamilyIndex == UINT32_MAX || !(flags & VK_QUEUE_COMPUTE_BIT)) transferFamilyIndex = i;
+    }
+
     for (uint32_t i = 0; i < queueFamiliesCount; i++)
     {
-        if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        // the cull pass is dispatched on the graphics queue between the frame's other commands
+        if ((queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT))
         {
             graphicsFamilyIndex = i;
             QFIBitmap |= QFI_GRAPHICS_BIT;
         }
-        if (physicalDeviceSupportsSurfaceKHR(device, i, surface))
+        if (options.headless || physicalDeviceSupportsSurfaceKHR(device, i, surface))
         {
             presentFamilyIndex = i;
             QFIBitmap |= QFI_PRESENT_BIT;
@@ -376,9 +1061,9 @@ static inline void findSuitableGPU(void)
     {
         VkPhysicalDevice device = devices[i];
 
-        if (!checkQueueFamilies(device, queueFamilies)) continue;
-        if (!checkExtensions(device, extensions))       continue;
-        if (!checkSwapchainCapabilities(device))        continue;
+        if (!checkQueueFamilies(device, queueFamilies))                   continue;
+        if (!options.headless && !checkExtensions(device, extensions))    continue;
+        if (!options.headless && !checkSwapchainCapabilities(device))     continue;
 
         physicalDevice = device;
         break;
@@ -390,11 +1075,12 @@ static inline void findSuitableGPU(void)
 
     if (physicalDevice == VK_NULL_HANDLE) FATAL("no suitable GPUs found!\n");
 
-    VkPhysicalDeviceProperties physicalDeviceProperties;
+    if (transferFamilyIndex == UINT32_MAX) transferFamilyIndex = graphicsFamilyIndex;
+
     vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
     INFO("selected GPU: %s\n", physicalDeviceProperties.deviceName);
 
-    INFO("GFI: %d PFI: %d\n", graphicsFamilyIndex, presentFamilyIndex);
+    INFO("GFI: %d PFI: %d TFI: %d\n", graphicsFamilyIndex, presentFamilyIndex, transferFamilyIndex);
 }
 
 
@@ -404,7 +1090,7 @@ static inline void createLogicalDevice(void)
 
     // TODO: this is ugly af
     VkDeviceQueueCreateInfo *queueCreateInfos       = NULL;
-    arrsetcap(queueCreateInfos, 2);
+    arrsetcap(queueCreateInfos, 3);
 
     VkDeviceQueueCreateInfo graphicsQueueCreateInfo = { 0 };
     graphicsQueueCreateInfo.sType                   = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
@@ -423,7 +1109,33 @@ static inline void createLogicalDevice(void)
         arrput(queueCreateInfos, presentQueueCreateInfo);
     }
 
+    if (transferFamilyIndex != graphicsFamilyIndex && transferFamilyIndex != presentFamilyIndex)
+    {
+        VkDeviceQueueCreateInfo transferQueueCreateInfo = { 0 };
+        transferQueueCreateInfo.sType                   = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        transferQueueCreateInfo.queueFamilyIndex        = transferFamilyIndex;
+        transferQueueCreateInfo.pQueuePriorities        = &queuePriority;
+        transferQueueCreateInfo.queueCount              = 1;
+        arrput(queueCreateInfos, transferQueueCreateInfo);
+    }
+
+    // cooked textures may be block compressed, enable whichever families the device can sample,
+    // meshes that didn't split into 16-bit chunks may index past maxDrawIndexedIndexValue without fullDrawIndexUint32,
+    // without multiDrawIndirect the draw list is issued one indirect draw at a time,
+    // and culled draws start at their own range of the culled instance buffer which needs drawIndirectFirstInstance
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures         = { 0 };
+    deviceFeatures.textureCompressionBC             = supportedFeatures.textureCompressionBC;
+    deviceFeatures.textureCompressionETC2           = supportedFeatures.textureCompressionETC2;
+    deviceFeatures.fullDrawIndexUint32              = supportedFeatures.fullDrawIndexUint32;
+    deviceFeatures.multiDrawIndirect                = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance        = supportedFeatures.drawIndirectFirstInstance;
+
+    multiDrawIndirect                               = supportedFeatures.multiDrawIndirect;
+    cullingEnabled                                  = !options.noCull && supportedFeatures.drawIndirectFirstInstance;
+    if (!options.noCull && !cullingEnabled) WARN("drawIndirectFirstInstance is unsupported, culling is disabled\n");
 
     VkDeviceCreateInfo createInfo                   = { 0 };
     createInfo.sType                                = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -431,7 +1143,7 @@ static inline void createLogicalDevice(void)
     createInfo.queueCreateInfoCount                 = arrlen(queueCreateInfos);
     createInfo.pEnabledFeatures                     = &deviceFeatures;
     createInfo.ppEnabledExtensionNames              = deviceExtensions;
-    createInfo.enabledExtensionCount                = deviceExtensionsCount;
+    createInfo.enabledExtensionCount                = options.headless ? 0 : deviceExtensionsCount;
 #ifdef DEBUG
     createInfo.ppEnabledLayerNames                  = &validationLayer;
     createInfo.enabledLayerCount                    = 1;
@@ -443,7 +1155,7 @@ static inline void createLogicalDevice(void)
     arrfree(queueCreateInfos);
 
     INFO("enabled device extensions:\n");
-    for (uint32_t i = 0; i < deviceExtensionsCount; i++)
+    for (uint32_t i = 0; i < createInfo.enabledExtensionCount; i++)
     {
         LOG("    - %s\n", deviceExtensions[i]);
     }
@@ -469,15 +1181,31 @@ static inline VkSurfaceFormatKHR selectSwapSurfaceFormat(const VkSurfaceFormatKH
     return subOptiomalFormat;
 }
 
-static inline VkPresentModeKHR selectSwapPresentMode(const VkPresentModeKHR *availableModes)
+static inline bool isPresentModeAvailable(const VkPresentModeKHR *availableModes, VkPresentModeKHR mode)
 {
     for (int i = 0; i < arrlen(availableModes); i++)
     {
-        VkPresentModeKHR availableMode = availableModes[i];
+        if (availableModes[i] == mode) return true;
+    }
+
+    return false;
+}
+
+static inline VkPresentModeKHR selectSwapPresentMode(const VkPresentModeKHR *availableModes)
+{
+    if (isPresentModeAvailable(availableModes, options.presentMode)) return options.presentMode;
+
+    for (size_t i = 0; i < ARR_LEN(presentModes); i++)
+    {
+        if (presentModes[i].mode != options.presentMode) continue;
 
-        if (availableMode == VK_PRESENT_MODE_MAILBOX_KHR)
+        for (size_t j = 0; j < ARR_LEN(presentModes[i].fallbacks); j++)
         {
-            return availableMode;
+            VkPresentModeKHR fallback = presentModes[i].fallbacks[j];
+            if (!isPresentModeAvailable(availableModes, fallback)) continue;
+
+            WARN("present mode %s is not supported, falling back to %s\n", presentModeName(options.presentMode), presentModeName(fallback));
+            return fallback;
         }
     }
 
@@ -505,13 +1233,19 @@ static void createSwapchain(void)
     uint32_t queueFamilyIndices[]       = { graphicsFamilyIndex, presentFamilyIndex };
 
     VkSurfaceFormatKHR surfaceFormat    = selectSwapSurfaceFormat(swapFormats);
-    VkPresentModeKHR presentMode        = selectSwapPresentMode(swapPresentModes);
+    swapPresentMode                     = selectSwapPresentMode(swapPresentModes);
     swapchainExtent                     = selectSwapExtent(&swapCapabilities);
     swapchainImageFormat                = surfaceFormat.format;
 
-    uint32_t imageCount                 = swapCapabilities.minImageCount + 1;
+    uint32_t imageCount                 = options.swapchainImages != 0 ? options.swapchainImages : swapCapabilities.minImageCount + 1;
+    if (imageCount < swapCapabilities.minImageCount)
+    {
+        WARN("surface needs at least %u swapchain images\n", swapCapabilities.minImageCount);
+        imageCount = swapCapabilities.minImageCount;
+    }
     if (swapCapabilities.maxImageCount != 0 && imageCount > swapCapabilities.maxImageCount)
     {
+        if (options.swapchainImages != 0) WARN("surface allows at most %u swapchain images\n", swapCapabilities.maxImageCount);
         imageCount = swapCapabilities.maxImageCount;
     }
 
@@ -526,9 +1260,10 @@ static void createSwapchain(void)
     createInfo.imageUsage                = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     createInfo.preTransform              = swapCapabilities.currentTransform;
     createInfo.compositeAlpha            = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    createInfo.presentMode               = presentMode;
+    createInfo.presentMode               = swapPresentMode;
     createInfo.clipped                   = VK_TRUE;
-    createInfo.oldSwapchain              = VK_NULL_HANDLE;
+    // handing over the current swapchain lets presentation continue while the new one is created
+    createInfo.oldSwapchain              = swapchain;
 
     if (graphicsFamilyIndex != presentFamilyIndex)
     {
@@ -545,110 +1280,303 @@ static void createSwapchain(void)
 
     uint32_t swapchainImagesCount;
     VK_TRY(vkGetSwapchainImagesKHR(device, swapchain, &swapchainImagesCount, NULL), FATAL("could not get swapchain images: %s\n", string_VkResult(result)));
-    arrsetlen(swapchainImages, imageCount);
+    // the implementation may create more images than requested
+    arrsetlen(swapchainImages, swapchainImagesCount);
     vkGetSwapchainImagesKHR(device, swapchain, &swapchainImagesCount, swapchainImages);
+
+    INFO("created %ux%u swapchain with %u images, present mode %s\n", swapchainExtent.width, swapchainExtent.height, swapchainImagesCount, presentModeName(swapPresentMode));
 }
 
 
+static VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectMask, uint32_t baseMipLevel, uint32_t mipLevels)
+{
+    VkImageViewCreateInfo createInfo           = { 0 };
+    createInfo.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    createInfo.image                           = image;
+    createInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+    createInfo.format                          = format;
+    createInfo.components.r                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.components.g                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.components.b                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY;
+    createInfo.subresourceRange.aspectMask     = aspectMask;
+    createInfo.subresourceRange.baseMipLevel   = baseMipLevel;
+    createInfo.subresourceRange.levelCount     = mipLevels;
+    createInfo.subresourceRange.baseArrayLayer = 0;
+    createInfo.subresourceRange.layerCount     = 1;
+
+    VkImageView imageView;
+    VK_TRY(vkCreateImageView(device, &createInfo, NULL, &imageView), FATAL("could not create image view: %s\n", string_VkResult(result)));
+
+    return imageView;
+}
+
 static void createImageViews(void)
 {
     arrsetlen(swapchainImageViews, arrlen(swapchainImages));
 
     for (int i = 0; i < arrlen(swapchainImages); i++)
     {
-        VkImageViewCreateInfo createInfo           = { 0 };
-        createInfo.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        createInfo.image                           = swapchainImages[i];
-        createInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
-        createInfo.format                          = swapchainImageFormat;
-        createInfo.components.r                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.components.g                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.components.b                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.components.a                    = VK_COMPONENT_SWIZZLE_IDENTITY;
-        createInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-        createInfo.subresourceRange.baseMipLevel   = 0;
-        createInfo.subresourceRange.levelCount     = 1;
-        createInfo.subresourceRange.baseArrayLayer = 0;
-        createInfo.subresourceRange.layerCount     = 1;
-
-        VK_TRY(vkCreateImageView(device, &createInfo, NULL, &swapchainImageViews[i]), FATAL("could not create swap image view: %s\n", string_VkResult(result)));
+        swapchainImageViews[i] = createImageView(swapchainImages[i], swapchainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1);
     }
 
     INFO("created %lld swapchain image views\n", arrlen(swapchainImageViews));
 }
 
-
-static inline void createRenderPass(void)
+// without culling the early pass is the only one, otherwise the late pass loads what the early one stored
+static VkRenderPass createPhaseRenderPass(CullPhase phase)
 {
+    bool first = phase == CULL_PHASE_EARLY;
+    bool last  = phase == CULL_PHASE_LATE || !cullingEnabled;
+
+    VkSubpassDependency *dependencies        = NULL;
+
+    // the depth buffer is shared by all frames, the previous pass writing it and the depth pyramid reading it have to finish first
     VkSubpassDependency dependency           = { 0 };
     dependency.srcSubpass                    = VK_SUBPASS_EXTERNAL;
-    dependency.srcStageMask                  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask                 = 0;
+    dependency.srcStageMask                  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | (cullingEnabled ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : 0);
+    dependency.srcAccessMask                 = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | (first ? 0 : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
     dependency.dstSubpass                    = 0;
-    dependency.dstStageMask                  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask                 = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    VkAttachmentDescription colorAttachment  = { 0 };
-    colorAttachment.format                   = swapchainImageFormat;
-    colorAttachment.samples                  = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp                   = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp                  = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.stencilLoadOp            = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp           = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout            = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout              = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    dependency.dstStageMask                  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask                 = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (first ? 0 : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT) |
+                                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    arrput(dependencies, dependency);
+
+    // the depth pyramid is built from the early pass's depth
+    if (!last)
+    {
+        VkSubpassDependency pyramidDependency    = { 0 };
+        pyramidDependency.srcSubpass             = 0;
+        pyramidDependency.srcStageMask           = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        pyramidDependency.srcAccessMask          = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        pyramidDependency.dstSubpass             = VK_SUBPASS_EXTERNAL;
+        pyramidDependency.dstStageMask           = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        pyramidDependency.dstAccessMask          = VK_ACCESS_SHADER_READ_BIT;
+        arrput(dependencies, pyramidDependency);
+    }
+
+    // headless frames are copied out right after the render pass
+    if (last && options.headless)
+    {
+        VkSubpassDependency readbackDependency   = { 0 };
+        readbackDependency.srcSubpass            = 0;
+        readbackDependency.srcStageMask          = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        readbackDependency.srcAccessMask         = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        readbackDependency.dstSubpass            = VK_SUBPASS_EXTERNAL;
+        readbackDependency.dstStageMask          = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        readbackDependency.dstAccessMask         = VK_ACCESS_TRANSFER_READ_BIT;
+        arrput(dependencies, readbackDependency);
+    }
+
+    VkAttachmentDescription attachments[2]   = { 0 };
+
+    VkAttachmentDescription *colorAttachment = &attachments[0];
+    colorAttachment->format                  = swapchainImageFormat;
+    colorAttachment->samples                 = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment->loadOp                  = first ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+    colorAttachment->storeOp                 = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment->stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment->stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment->initialLayout           = first ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment->finalLayout             = !last ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    // depth is only kept from the early pass to the late one, read by the depth pyramid in between
+    VkAttachmentDescription *depthAttachment = &attachments[1];
+    depthAttachment->format                  = depthFormat;
+    depthAttachment->samples                 = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment->loadOp                  = first ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthAttachment->storeOp                 = last ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment->stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment->stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment->initialLayout           = first ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    depthAttachment->finalLayout             = last ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef = { 0 };
     colorAttachmentRef.attachment            = 0;
     colorAttachmentRef.layout                = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depthAttachmentRef = { 0 };
+    depthAttachmentRef.attachment            = 1;
+    depthAttachmentRef.layout                = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass             = { 0 };
     subpass.pipelineBindPoint                = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount             = 1;
     subpass.pColorAttachments                = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment          = &depthAttachmentRef;
 
     VkRenderPassCreateInfo createInfo        = { 0 };
     createInfo.sType                         = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    createInfo.dependencyCount               = 1;
-    createInfo.pDependencies                 = &dependency;
-    createInfo.attachmentCount               = 1;
-    createInfo.pAttachments                  = &colorAttachment;
+    createInfo.dependencyCount               = arrlen(dependencies);
+    createInfo.pDependencies                 = dependencies;
+    createInfo.attachmentCount               = ARR_LEN(attachments);
+    createInfo.pAttachments                  = attachments;
     createInfo.subpassCount                  = 1;
     createInfo.pSubpasses                    = &subpass;
 
-    VK_TRY(vkCreateRenderPass(device, &createInfo, NULL, &renderPass), FATAL("could not create render pass: %s\n", string_VkResult(result)));
+    VkRenderPass pass;
+    VK_TRY(vkCreateRenderPass(device, &createInfo, NULL, &pass), FATAL("could not create render pass: %s\n", string_VkResult(result)));
+
+    arrfree(dependencies);
+
+    return pass;
+}
+
+static inline void createRenderPass(void)
+{
+    renderPass = createPhaseRenderPass(CULL_PHASE_EARLY);
+    if (cullingEnabled) lateRenderPass = createPhaseRenderPass(CULL_PHASE_LATE);
 }
 
 
 static inline void createDescriptorSetLayout(void)
 {
-    VkDescriptorSetLayoutBinding layoutBinding = { 0 };
-    layoutBinding.binding                      = 0;
-    layoutBinding.descriptorType               = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    layoutBinding.descriptorCount              = 1;
-    layoutBinding.stageFlags                   = VK_SHADER_STAGE_VERTEX_BIT;
-
-    VkDescriptorSetLayoutCreateInfo createInfo = { 0 };
-    createInfo.sType                           = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    createInfo.bindingCount                    = 1;
-    createInfo.pBindings                       = &layoutBinding;
+    VkDescriptorSetLayoutBinding layoutBindings[2] = { 0 };
+    layoutBindings[0].binding                      = 0;
+    layoutBindings[0].descriptorType               = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    layoutBindings[0].descriptorCount              = 1;
+    layoutBindings[0].stageFlags                   = VK_SHADER_STAGE_VERTEX_BIT;
+    layoutBindings[1].binding                      = 1;
+    layoutBindings[1].descriptorType               = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    layoutBindings[1].descriptorCount              = 1;
+    layoutBindings[1].stageFlags                   = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo createInfo     = { 0 };
+    createInfo.sType                               = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    createInfo.bindingCount                        = ARR_LEN(layoutBindings);
+    createInfo.pBindings                           = layoutBindings;
 
     VK_TRY(vkCreateDescriptorSetLayout(device, &createInfo, NULL, &descriptorSetLayout), FATAL("could not create descriptor set layout: %s\n", string_VkResult(result)));
 }
 
 
-static VkShaderModule createShaderModule(ByteBuf code)
+static inline void fillPipelineCacheHeader(PipelineCacheHeader *header, uint64_t dataSize)
+{
+    *header               = (PipelineCacheHeader){ 0 };
+    header->magic         = PIPELINE_CACHE_MAGIC;
+    header->vendorID      = physicalDeviceProperties.vendorID;
+    header->deviceID      = physicalDeviceProperties.deviceID;
+    header->driverVersion = physicalDeviceProperties.driverVersion;
+    header->dataSize      = dataSize;
+    memcpy(header->pipelineCacheUUID, physicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+// returns the cache blob if the file exists and was written by this exact device and driver, NULL otherwise
+static void *loadPipelineCacheData(size_t *dataSize)
+{
+    FILE *file = fopen(PIPELINE_CACHE_PATH, "rb");
+    if (file == NULL) return NULL;
+
+    PipelineCacheHeader header, expected;
+    void *data = NULL;
+
+    if (fread(&header, sizeof(header), 1, file) != 1) goto invalid;
+
+    fillPipelineCacheHeader(&expected, header.dataSize);
+    if (memcmp(&header, &expected, sizeof(header)) != 0) goto invalid;
+
+    // the blob starts with VkPipelineCacheHeaderVersionOne (length, version, vendor, device, uuid)
+    if (header.dataSize < 16 + VK_UUID_SIZE) goto invalid;
+
+    // a corrupt size must not turn into a huge allocation, the blob has to be what's left of the file
+    long headerEnd = ftell(file);
+    if (headerEnd < 0 || fseek(file, 0, SEEK_END) != 0) goto invalid;
+    long fileSize = ftell(file);
+    if (fileSize < headerEnd || header.dataSize > (uint64_t)(fileSize - headerEnd) || fseek(file, headerEnd, SEEK_SET) != 0) goto invalid;
+
+    data = malloc(header.dataSize);
+    if (data == NULL || fread(data, header.dataSize, 1, file) != 1) goto invalid;
+
+    uint32_t blobHeader[4];
+    memcpy(blobHeader, data, sizeof(blobHeader));
+    if (blobHeader[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        blobHeader[2] != header.vendorID ||
+        blobHeader[3] != header.deviceID ||
+        memcmp((char *)data + 16, header.pipelineCacheUUID, VK_UUID_SIZE) != 0) goto invalid;
+
+    fclose(file);
+    *dataSize = header.dataSize;
+    return data;
+
+invalid:
+    INFO("ignoring stale or invalid pipeline cache %s\n", PIPELINE_CACHE_PATH);
+    free(data);
+    fclose(file);
+    return NULL;
+}
+
+static inline void createPipelineCache(void)
+{
+    size_t dataSize = 0;
+    void *data      = loadPipelineCacheData(&dataSize);
+
+    VkPipelineCacheCreateInfo createInfo = { 0 };
+    createInfo.sType                     = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize           = dataSize;
+    createInfo.pInitialData              = data;
+
+    VK_TRY(vkCreatePipelineCache(device, &createInfo, NULL, &pipelineCache), FATAL("could not create pipeline cache: %s\n", string_VkResult(result)));
+
+    if (data != NULL) LOG("loaded %llu bytes of pipeline cache\n", (unsigned long long)dataSize);
+    free(data);
+}
+
+// writes to a temporary file first so a crash mid-write can't leave a truncated cache behind
+static inline void savePipelineCache(void)
+{
+    size_t dataSize;
+    VK_TRY(vkGetPipelineCacheData(device, pipelineCache, &dataSize, NULL), { ERROR("could not get pipeline cache size: %s\n", string_VkResult(result)); return; });
+
+    void *data = malloc(dataSize);
+    VK_TRY(vkGetPipelineCacheData(device, pipelineCache, &dataSize, data), { ERROR("could not get pipeline cache data: %s\n", string_VkResult(result)); free(data); return; });
+
+    PipelineCacheHeader header;
+    fillPipelineCacheHeader(&header, dataSize);
+
+    FILE *file = fopen(PIPELINE_CACHE_PATH ".tmp", "wb");
+    if (file == NULL)
+    {
+        ERROR("could not open %s for writing\n", PIPELINE_CACHE_PATH ".tmp");
+        free(data);
+        return;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, dataSize, 1, file) == 1;
+    written      = fclose(file) == 0 && written;
+    free(data);
+
+    // the CRT's rename fails when the destination exists
+#ifdef _WIN32
+    bool replaced = written && MoveFileExA(PIPELINE_CACHE_PATH ".tmp", PIPELINE_CACHE_PATH, MOVEFILE_REPLACE_EXISTING);
+#else
+    bool replaced = written && rename(PIPELINE_CACHE_PATH ".tmp", PIPELINE_CACHE_PATH) == 0;
+#endif
+
+    if (!replaced)
+    {
+        ERROR("could not write pipeline cache %s\n", PIPELINE_CACHE_PATH);
+        remove(PIPELINE_CACHE_PATH ".tmp");
+    }
+}
+
+
+static VkShaderModule createShaderModule(const char *path)
 {
+    AssetView code;
+    if (!mapAsset(path, &code)) FATAL("could not load shader %s\n", path);
+
+    // mapped views are page aligned, so the words can be handed to the driver in place
+    if (code.size < 4 || code.size % 4 != 0 || *(const uint32_t *)code.data != SPIRV_MAGIC) FATAL("%s is not a SPIR-V module\n", path);
+
     VkShaderModuleCreateInfo createInfo = { 0 };
     createInfo.sType                    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize                 = code.count;
-    // FIXME: investigate this?
-    createInfo.pCode                    = (uint32_t *)code.data;
+    createInfo.codeSize                 = code.size;
+    createInfo.pCode                    = code.data;
 
     VkShaderModule shaderModule;
     VK_TRY(vkCreateShaderModule(device, &createInfo, NULL, &shaderModule), FATAL("could not create shader module: %s\n", string_VkResult(result)));
 
-    free(code.data);
+    unmapAsset(&code);
 
     return shaderModule;
 }
@@ -656,10 +1584,17 @@ static VkShaderModule createShaderModule(ByteBuf code)
 static inline void createGraphicsPipeline(void)
 {
     {
+        VkPushConstantRange pushConstants = { 0 };
+        pushConstants.stageFlags          = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstants.offset              = 0;
+        pushConstants.size                = sizeof(MeshConstants);
+
         VkPipelineLayoutCreateInfo createInfo = { 0 };
         createInfo.sType                      = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         createInfo.setLayoutCount             = 1;
         createInfo.pSetLayouts                = &descriptorSetLayout;
+        createInfo.pushConstantRangeCount     = 1;
+        createInfo.pPushConstantRanges        = &pushConstants;
 
         VK_TRY(vkCreatePipelineLayout(device, &createInfo, NULL, &pipelineLayout), FATAL("could not create pipeline layout: %s\n", string_VkResult(result)));
     }
@@ -669,8 +1604,8 @@ static inline void createGraphicsPipeline(void)
         VK_DYNAMIC_STATE_SCISSOR
     };
 
-    VkShaderModule vertexShader   = createShaderModule(readFile("./shaders/vert.spv"));
-    VkShaderModule fragmentShader = createShaderModule(readFile("./shaders/frag.spv"));
+    VkShaderModule vertexShader   = createShaderModule("./shaders/vert.spv");
+    VkShaderModule fragmentShader = createShaderModule("./shaders/frag.spv");
 
     VkPipelineShaderStageCreateInfo vertCreateInfo     = { 0 };
     vertCreateInfo.sType                               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -691,25 +1626,35 @@ static inline void createGraphicsPipeline(void)
     dynamicState.dynamicStateCount                     = ARR_LEN(dynamicStates);
     dynamicState.pDynamicStates                        = dynamicStates;
 
-    VkVertexInputBindingDescription binding            = { 0 };
-    binding.binding                                    = 0;
-    binding.stride                                     = sizeof(Vertex);
-    binding.inputRate                                  = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    VkVertexInputAttributeDescription attributes[2]    = { 0 };
-    attributes[0].binding                              = 0;
-    attributes[0].location                             = 0;
-    attributes[0].format                               = VK_FORMAT_R32G32B32_SFLOAT;
-    attributes[0].offset                               = offsetof(Vertex, pos);
-    attributes[1].binding                              = 0;
-    attributes[1].location                             = 1;
-    attributes[1].format                               = VK_FORMAT_R32G32B32_SFLOAT;
-    attributes[1].offset                               = offsetof(Vertex, color);
-
+    VkVertexInputBindingDescription bindings[2]        = { 0 };
+    bindings[0].binding                                = 0;
+    bindings[0].stride                                 = mesh.vertexStride;
+    bindings[0].inputRate                              = VK_VERTEX_INPUT_RATE_VERTEX;
+    bindings[1].binding                                = INSTANCE_BINDING;
+    bindings[1].stride                                 = sizeof(Instance);
+    bindings[1].inputRate                              = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    // the instance's mat4 takes one location per column
+    VkVertexInputAttributeDescription attributes[VERTEX_ATTRIBUTE_COUNT + 4] = { 0 };
+    for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++)
+    {
+        attributes[i].binding                          = 0;
+        attributes[i].location                         = i;
+        attributes[i].format                           = mesh.attributes[i].format;
+        attributes[i].offset                           = mesh.attributes[i].offset;
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        attributes[VERTEX_ATTRIBUTE_COUNT + i].binding  = INSTANCE_BINDING;
+        attributes[VERTEX_ATTRIBUTE_COUNT + i].location = INSTANCE_LOCATION + i;
+        attributes[VERTEX_ATTRIBUTE_COUNT + i].format   = VK_FORMAT_R32G32B32A32_SFLOAT;
+        attributes[VERTEX_ATTRIBUTE_COUNT + i].offset   = offsetof(Instance, model) + i * sizeof(vec4);
+    }
+
     VkPipelineVertexInputStateCreateInfo vertexInput   = { 0 };
     vertexInput.sType                                  = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInput.vertexBindingDescriptionCount          = 1;
-    vertexInput.pVertexBindingDescriptions             = &binding;
+    vertexInput.vertexBindingDescriptionCount          = ARR_LEN(bindings);
+    vertexInput.pVertexBindingDescriptions             = bindings;
     vertexInput.vertexAttributeDescriptionCount        = ARR_LEN(attributes);
     vertexInput.pVertexAttributeDescriptions           = attributes;
 
@@ -745,6 +1690,14 @@ static inline void createGraphicsPipeline(void)
     multisampling.alphaToCoverageEnable                = VK_FALSE;
     multisampling.alphaToOneEnable                     = VK_FALSE;
 
+    VkPipelineDepthStencilStateCreateInfo depthStencil = { 0 };
+    depthStencil.sType                                 = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable                       = VK_TRUE;
+    depthStencil.depthWriteEnable                      = VK_TRUE;
+    depthStencil.depthCompareOp                        = options.reverseZ ? VK_COMPARE_OP_GREATER : VK_COMPARE_OP_LESS;
+    depthStencil.depthBoundsTestEnable                 = VK_FALSE;
+    depthStencil.stencilTestEnable                     = VK_FALSE;
+
     VkPipelineColorBlendAttachmentState colorBlendAtt  = { 0 };
     colorBlendAtt.colorWriteMask                       = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
     colorBlendAtt.blendEnable                          = VK_FALSE;
@@ -770,14 +1723,16 @@ static inline void createGraphicsPipeline(void)
     createInfo.pViewportState                          = &viewport;
     createInfo.pRasterizationState                     = &rasterizer;
     createInfo.pMultisampleState                       = &multisampling;
-    createInfo.pDepthStencilState                      = NULL;
+    createInfo.pDepthStencilState                      = &depthStencil;
     createInfo.pColorBlendState                        = &colorBlending;
     createInfo.pDynamicState                           = &dynamicState;
     createInfo.layout                                  = pipelineLayout;
     createInfo.renderPass                              = renderPass;
     createInfo.subpass                                 = 0;
 
-    VK_TRY(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &createInfo, NULL, &graphicsPipeline), FATAL("could not create graphics pipeline: %s\n", string_VkResult(result)));
+    double start = getTime();
+    VK_TRY(vkCreateGraphicsPipelines(device, pipelineCache, 1, &createInfo, NULL, &graphicsPipeline), FATAL("could not create graphics pipeline: %s\n", string_VkResult(result)));
+    LOG("created graphics pipeline in %.3f ms\n", 1000 * (getTime() - start));
 
     vkDestroyShaderModule(device, vertexShader, NULL);
     vkDestroyShaderModule(device, fragmentShader, NULL);
@@ -790,11 +1745,13 @@ static void createFramebuffers(void)
 
     for (int i = 0; i < arrlen(swapchainImageViews); i++)
     {
+        VkImageView attachments[]          = { swapchainImageViews[i], depthImageView };
+
         VkFramebufferCreateInfo createInfo = { 0 };
         createInfo.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         createInfo.renderPass              = renderPass;
-        createInfo.attachmentCount         = 1;
-        createInfo.pAttachments            = &swapchainImageViews[i];
+        createInfo.attachmentCount         = ARR_LEN(attachments);
+        createInfo.pAttachments            = attachments;
         createInfo.width                   = swapchainExtent.width;
         createInfo.height                  = swapchainExtent.height;
         createInfo.layers                  = 1;
@@ -821,17 +1778,24 @@ static inline void allocateCommandBuffers(void)
     allocateInfo.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocateInfo.commandPool                 = commandPool;
     allocateInfo.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocateInfo.commandBufferCount          = FRAMES_IN_FLIGHT;
+    allocateInfo.commandBufferCount          = options.framesInFlight;
+
+    arrsetlen(commandBuffers, options.framesInFlight);
+    arrsetlen(drawCommandBuffers, options.framesInFlight * CULL_PHASE_COUNT);
+    arrsetlen(drawCommandsValid, options.framesInFlight);
+    memset(drawCommandsValid, 0, options.framesInFlight * sizeof(bool));
 
     VK_TRY(vkAllocateCommandBuffers(device, &allocateInfo, commandBuffers), FATAL("could not allocate command buffer: %s\n", string_VkResult(result)));
+
+    allocateInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocateInfo.commandBufferCount = options.framesInFlight * CULL_PHASE_COUNT;
+
+    VK_TRY(vkAllocateCommandBuffers(device, &allocateInfo, drawCommandBuffers), FATAL("could not allocate draw command buffers: %s\n", string_VkResult(result)));
 }
 
 
 static uint32_t findMemoryTypeIndex(uint32_t typeFilter, VkMemoryPropertyFlags propertyFlags)
 {
-    VkPhysicalDeviceMemoryProperties memoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-
     for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
     {
         if (typeFilter & (1 << i) && (memoryProperties.memoryTypes[i].propertyFlags & propertyFlags) == propertyFlags) return i;
@@ -840,33 +1804,265 @@ static uint32_t findMemoryTypeIndex(uint32_t typeFilter, VkMemoryPropertyFlags p
     FATAL("could not find suitable memory type!\n");
 }
 
-// TODO: create a buffer memory allocator to prevent allocating many individual memory segments
-static void createBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags propertyFlags, VkBuffer *buffer, VkDeviceMemory *bufferMemory)
+static inline void createMemoryArena(void)
+{
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    maxMemoryAllocationCount = physicalDeviceProperties.limits.maxMemoryAllocationCount;
+}
+
+static MemoryBlock *createMemoryBlock(uint32_t memoryType, VkDeviceSize size, bool linear, bool dedicated)
+{
+    if (memoryAllocationCount >= maxMemoryAllocationCount) FATAL("could not allocate memory block: maxMemoryAllocationCount (%u) reached\n", maxMemoryAllocationCount);
+
+    MemoryBlock *block = calloc(1, sizeof(MemoryBlock));
+    block->memoryType  = memoryType;
+    block->size        = size;
+    block->linear      = linear;
+    block->dedicated   = dedicated;
+
+    VkMemoryAllocateInfo allocInfo = { 0 };
+    allocInfo.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize       = size;
+    allocInfo.memoryTypeIndex      = memoryType;
+
+    VK_TRY(vkAllocateMemory(device, &allocInfo, NULL, &block->memory), FATAL("could not allocate memory block: %s\n", string_VkResult(result)));
+    memoryAllocationCount++;
+
+    // host visible blocks stay mapped for their whole lifetime, a memory object can only be mapped once
+    if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        VK_TRY(vkMapMemory(device, block->memory, 0, size, 0, &block->mapped), FATAL("could not map memory block: %s\n", string_VkResult(result)));
+    }
+
+    arrput(block->freeRanges, ((MemoryRange){ .offset = 0, .size = size }));
+    arrput(memoryBlocks[memoryType], block);
+
+    return block;
+}
+
+static void destroyMemoryBlock(MemoryBlock *block)
+{
+    MemoryBlock **blocks = memoryBlocks[block->memoryType];
+    for (int i = 0; i < arrlen(blocks); i++)
+    {
+        if (blocks[i] == block)
+        {
+            arrdel(memoryBlocks[block->memoryType], i);
+            break;
+        }
+    }
+
+    if (block->mapped != NULL) vkUnmapMemory(device, block->memory);
+    vkFreeMemory(device, block->memory, NULL);
+    memoryAllocationCount--;
+
+    arrfree(block->freeRanges);
+    free(block);
+}
+
+// best-fit search over the (offset sorted) free ranges of a block
+static bool allocateFromBlock(MemoryBlock *block, VkDeviceSize size, VkDeviceSize alignment, Allocation *allocation)
+{
+    int          bestRange  = -1;
+    VkDeviceSize bestOffset = 0;
+
+    for (int i = 0; i < arrlen(block->freeRanges); i++)
+    {
+        MemoryRange range  = block->freeRanges[i];
+        VkDeviceSize start = ALIGN_UP(range.offset, alignment);
+
+        if (start + size > range.offset + range.size) continue;
+        if (bestRange != -1 && range.size >= block->freeRanges[bestRange].size) continue;
+
+        bestRange  = i;
+        bestOffset = start;
+    }
+
+    if (bestRange == -1) return false;
+
+    MemoryRange range = block->freeRanges[bestRange];
+    arrdel(block->freeRanges, bestRange);
+
+    // the alignment padding and the tail stay in the free list as separate ranges
+    VkDeviceSize tail = range.offset + range.size - (bestOffset + size);
+    if (tail > 0)                  arrins(block->freeRanges, bestRange, ((MemoryRange){ .offset = bestOffset + size, .size = tail }));
+    if (bestOffset > range.offset) arrins(block->freeRanges, bestRange, ((MemoryRange){ .offset = range.offset, .size = bestOffset - range.offset }));
+
+    block->used += size;
+    block->allocationCount++;
+
+    allocation->block  = block;
+    allocation->memory = block->memory;
+    allocation->offset = bestOffset;
+    allocation->size   = size;
+    allocation->mapped = block->mapped != NULL ? (char *)block->mapped + bestOffset : NULL;
+
+    return true;
+}
+
+static void allocateMemory(const VkMemoryRequirements *requirements, VkMemoryPropertyFlags propertyFlags, bool linear, Allocation *allocation)
+{
+    uint32_t memoryType = findMemoryTypeIndex(requirements->memoryTypeBits, propertyFlags);
+
+    // big resources get a block of their own instead of hogging half of a shared one
+    if (requirements->size > MEMORY_BLOCK_SIZE / 2)
+    {
+        MemoryBlock *block = createMemoryBlock(memoryType, requirements->size, linear, true);
+        allocateFromBlock(block, requirements->size, requirements->alignment, allocation);
+        return;
+    }
+
+    MemoryBlock **blocks = memoryBlocks[memoryType];
+    for (int i = 0; i < arrlen(blocks); i++)
+    {
+        // linear and optimal resources never share a block so bufferImageGranularity can be ignored
+        if (blocks[i]->dedicated || blocks[i]->linear != linear) continue;
+        if (allocateFromBlock(blocks[i], requirements->size, requirements->alignment, allocation)) return;
+    }
+
+    VkDeviceSize heapSize  = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+    VkDeviceSize blockSize = MEMORY_BLOCK_SIZE;
+    if (blockSize > heapSize / 8) blockSize = ALIGN_UP(heapSize / 8 > requirements->size ? heapSize / 8 : requirements->size, requirements->alignment);
+
+    MemoryBlock *block = createMemoryBlock(memoryType, blockSize, linear, false);
+    if (!allocateFromBlock(block, requirements->size, requirements->alignment, allocation)) FATAL("could not sub-allocate %llu B from a fresh memory block\n", (unsigned long long) requirements->size);
+}
+
+static void freeMemory(Allocation *allocation)
+{
+    MemoryBlock *block = allocation->block;
+    if (block == NULL) return;
+
+    MemoryRange freed = { .offset = allocation->offset, .size = allocation->size };
+
+    int i = 0;
+    while (i < arrlen(block->freeRanges) && block->freeRanges[i].offset < freed.offset) i++;
+
+    // coalesce with the neighbouring ranges
+    if (i < arrlen(block->freeRanges) && freed.offset + freed.size == block->freeRanges[i].offset)
+    {
+        freed.size += block->freeRanges[i].size;
+        arrdel(block->freeRanges, i);
+    }
+    if (i > 0 && block->freeRanges[i - 1].offset + block->freeRanges[i - 1].size == freed.offset)
+    {
+        block->freeRanges[i - 1].size += freed.size;
+    }
+    else arrins(block->freeRanges, i, freed);
+
+    block->used -= allocation->size;
+    block->allocationCount--;
+
+    *allocation = (Allocation){ 0 };
+
+    if (block->allocationCount > 0) return;
+
+    // keep one empty shared block per memory type around to avoid thrashing vkAllocateMemory
+    bool keep = !block->dedicated;
+    MemoryBlock **blocks = memoryBlocks[block->memoryType];
+    for (int j = 0; keep && j < arrlen(blocks); j++)
+    {
+        if (blocks[j] != block && !blocks[j]->dedicated && blocks[j]->linear == block->linear && blocks[j]->allocationCount == 0) keep = false;
+    }
+
+    if (!keep) destroyMemoryBlock(block);
+}
+
+static void printMemoryStats(void)
+{
+    INFO("device memory: %u / %u allocations\n", memoryAllocationCount, maxMemoryAllocationCount);
+
+    for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++)
+    {
+        MemoryBlock **blocks = memoryBlocks[type];
+        if (arrlen(blocks) == 0) continue;
+
+        VkDeviceSize total = 0, used = 0, largestFree = 0;
+        uint32_t     allocations = 0, freeRanges = 0;
+
+        for (int i = 0; i < arrlen(blocks); i++)
+        {
+            total       += blocks[i]->size;
+            used        += blocks[i]->used;
+            allocations += blocks[i]->allocationCount;
+            freeRanges  += arrlen(blocks[i]->freeRanges);
+
+            for (int j = 0; j < arrlen(blocks[i]->freeRanges); j++)
+            {
+                if (blocks[i]->freeRanges[j].size > largestFree) largestFree = blocks[i]->freeRanges[j].size;
+            }
+        }
+
+        // 0% means all free memory is one contiguous range, approaching 100% means it is scattered in tiny ranges
+        VkDeviceSize freeSize      = total - used;
+        double       fragmentation = freeSize > 0 ? 100.0 * (1.0 - (double) largestFree / (double) freeSize) : 0.0;
+
+        LOG("    - type %u: %lld blocks, %u allocations, %llu / %llu KiB used, %u free ranges (largest %llu KiB), %.1f%% fragmented\n",
+            type, (long long) arrlen(blocks), allocations,
+            (unsigned long long) used / 1024, (unsigned long long) total / 1024,
+            freeRanges, (unsigned long long) largestFree / 1024, fragmentation);
+    }
+}
+
+static inline void destroyMemoryArena(void)
+{
+    for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; type++)
+    {
+        while (arrlen(memoryBlocks[type]) > 0)
+        {
+            MemoryBlock *block = memoryBlocks[type][0];
+            if (block->allocationCount > 0) WARN("leaked %u allocations in memory type %u\n", block->allocationCount, type);
+            destroyMemoryBlock(block);
+        }
+
+        arrfree(memoryBlocks[type]);
+    }
+}
+
+// resources touched by the transfer queue are shared with the graphics family instead of transferring ownership
+static void setSharingMode(bool transfer, VkSharingMode *sharingMode, uint32_t *queueFamilyIndexCount, const uint32_t **queueFamilyIndices)
+{
+    static uint32_t sharedFamilyIndices[2];
+    sharedFamilyIndices[0] = graphicsFamilyIndex;
+    sharedFamilyIndices[1] = transferFamilyIndex;
+
+    if (transfer && transferFamilyIndex != graphicsFamilyIndex)
+    {
+        *sharingMode           = VK_SHARING_MODE_CONCURRENT;
+        *queueFamilyIndexCount = 2;
+        *queueFamilyIndices    = sharedFamilyIndices;
+    }
+    else *sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+}
+
+static void createBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags propertyFlags, VkBuffer *buffer, Allocation *allocation)
 {
     VkBufferCreateInfo createInfo  = { 0 };
     createInfo.sType               = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     createInfo.size                = size;
     createInfo.usage               = usageFlags;
-    createInfo.sharingMode         = VK_SHARING_MODE_EXCLUSIVE;
+    setSharingMode(usageFlags & (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT), &createInfo.sharingMode, &createInfo.queueFamilyIndexCount, &createInfo.pQueueFamilyIndices);
 
     VK_TRY(vkCreateBuffer(device, &createInfo, NULL, buffer), FATAL("could not create buffer: %s\n", string_VkResult(result)));
 
     VkMemoryRequirements memoryRequirements;
     vkGetBufferMemoryRequirements(device, *buffer, &memoryRequirements);
 
-    VkMemoryAllocateInfo allocInfo = { 0 };
-    allocInfo.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize       = memoryRequirements.size;
-    allocInfo.memoryTypeIndex      = findMemoryTypeIndex(memoryRequirements.memoryTypeBits, propertyFlags);
-
-    VK_TRY(vkAllocateMemory(device, &allocInfo, NULL, bufferMemory), FATAL("could not allocate buffer memory: %s\n", string_VkResult(result)));
+    allocateMemory(&memoryRequirements, propertyFlags, true, allocation);
 
-    vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
+    VK_TRY(vkBindBufferMemory(device, *buffer, allocation->memory, allocation->offset), FATAL("could not bind buffer memory: %s\n", string_VkResult(result)));
 
     INFO("created buffer (%lld B)\n", size);
 }
 
-static void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage *image, VkDeviceMemory *memory)
+static void destroyBuffer(VkBuffer buffer, Allocation *allocation)
+{
+    vkDestroyBuffer(device, buffer, NULL);
+    freeMemory(allocation);
+}
+
+static void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage *image, Allocation *allocation)
 {
     VkImageCreateInfo createInfo = { 0 };
     createInfo.sType             = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -874,324 +2070,1763 @@ static void createImage(uint32_t width, uint32_t height, VkFormat format, VkImag
     createInfo.extent.width      = width;
     createInfo.extent.height     = height;
     createInfo.extent.depth      = 1;
-    createInfo.mipLevels         = 1;
+    createInfo.mipLevels         = mipLevels;
     createInfo.arrayLayers       = 1;
     createInfo.format            = format;
     createInfo.tiling            = tiling;
     createInfo.initialLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
     createInfo.usage             = usage;
-    createInfo.sharingMode       = VK_SHARING_MODE_EXCLUSIVE;
     createInfo.samples           = VK_SAMPLE_COUNT_1_BIT;
+    setSharingMode(usage & (VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT), &createInfo.sharingMode, &createInfo.queueFamilyIndexCount, &createInfo.pQueueFamilyIndices);
 
-    VK_TRY(vkCreateImage(device, &createInfo, NULL, &textureImage), FATAL("could not create image: %s\n", string_VkResult(result)));
+    VK_TRY(vkCreateImage(device, &createInfo, NULL, image), FATAL("could not create image: %s\n", string_VkResult(result)));
 
     VkMemoryRequirements memoryRequirements;
-    vkGetImageMemoryRequirements(device, textureImage, &memoryRequirements);
-
-    VkMemoryAllocateInfo allocInfo = { 0 };
-    allocInfo.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize       = memoryRequirements.size;
-    allocInfo.memoryTypeIndex      = findMemoryTypeIndex(memoryRequirements.memoryTypeBits, properties);
+    vkGetImageMemoryRequirements(device, *image, &memoryRequirements);
 
-    VK_TRY(vkAllocateMemory(device, &allocInfo, NULL, memory), FATAL("could not allocate image memory: %s\n", string_VkResult(result)));
+    allocateMemory(&memoryRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR, allocation);
 
-    vkBindImageMemory(device, *image, *memory, 0);
+    VK_TRY(vkBindImageMemory(device, *image, allocation->memory, allocation->offset), FATAL("could not bind image memory: %s\n", string_VkResult(result)));
 }
 
-static inline void createTextureImage(void)
+static void destroyImage(VkImage image, Allocation *allocation)
 {
-    int width, height, channels;
-
-    stbi_uc *pixels = stbi_load("./assets/texture.jpg", &width, &height, &channels, STBI_rgb_alpha);
-    if (!pixels) FATAL("could not load texture image\n");
-
-    VkDeviceSize size = width * height * 4;
+    vkDestroyImage(device, image, NULL);
+    freeMemory(allocation);
+}
 
-    VkBuffer       stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+static inline VkFormat selectDepthFormat(void)
+{
+    // the depth pyramid samples the depth buffer when culling is enabled
+    VkFormatFeatureFlags required  = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | (cullingEnabled ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : 0);
+    VkFormat             formats[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, size, 0, &data);
-    memcpy(data, pixels, size);
-    vkUnmapMemory(device, stagingBufferMemory);
+    for (size_t i = 0; i < ARR_LEN(formats); i++)
+    {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, formats[i], &properties);
 
-    stbi_image_free(pixels);
+        if ((properties.optimalTilingFeatures & required) == required) return formats[i];
+    }
 
-    createImage(width, height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &textureImage, &textureImageMemory);
+    FATAL("no supported depth format\n");
 }
 
-
-static void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size)
+// sized to the swapchain, so recreated along with it
+static void createDepthTargets(void)
 {
-    // TODO: consider creating own command pool
-    VkCommandBufferAllocateInfo allocInfo = { 0 };
-    allocInfo.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool                 = commandPool;
-    allocInfo.commandBufferCount          = 1;
+    if (depthFormat == VK_FORMAT_UNDEFINED)
+    {
+        depthFormat = selectDepthFormat();
+        INFO("depth format: %s\n", string_VkFormat(depthFormat));
+    }
 
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (cullingEnabled ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+    createImage(swapchainExtent.width, swapchainExtent.height, 1, depthFormat, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthImage, &depthImageAllocation);
+    depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
 
-    VkCommandBufferBeginInfo beginInfo    = { 0 };
-    beginInfo.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags                       = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (!cullingEnabled) return;
 
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    depthPyramidLevels = mipLevelCount(swapchainExtent.width, swapchainExtent.height);
+    depthPyramidValid  = false;
 
-    VkBufferCopy copyRegion = { 0 };
-    copyRegion.size         = size;
+    createImage(swapchainExtent.width, swapchainExtent.height, depthPyramidLevels, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthPyramid, &depthPyramidAllocation);
+    depthPyramidView = createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, depthPyramidLevels);
+
+    arrsetlen(depthPyramidLevelViews, depthPyramidLevels);
+    for (uint32_t i = 0; i < depthPyramidLevels; i++)
+    {
+        depthPyramidLevelViews[i] = createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, i, 1);
+    }
+}
 
-    vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyRegion);
-    vkEndCommandBuffer(commandBuffer);
+static void destroyDepthTargets(void)
+{
+    vkDestroyImageView(device, depthImageView, NULL);
+    destroyImage(depthImage, &depthImageAllocation);
 
-    VkSubmitInfo submitInfo       = { 0 };
-    submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers    = &commandBuffer;
+    if (!cullingEnabled) return;
 
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
+    for (uint32_t i = 0; i < depthPyramidLevels; i++) vkDestroyImageView(device, depthPyramidLevelViews[i], NULL);
+    arrfree(depthPyramidLevelViews);
 
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    vkDestroyImageView(device, depthPyramidView, NULL);
+    destroyImage(depthPyramid, &depthPyramidAllocation);
 }
 
-static inline void createVertexBuffer(void)
+// headless stand-in for the swapchain: one color target per frame in flight, rendered to and read back directly
+static inline void createOffscreenTargets(void)
 {
-    VkDeviceSize size = sizeof(vertices);
+    swapchainImageFormat = HEADLESS_FORMAT;
+    swapchainExtent      = (VkExtent2D){ .width = options.width, .height = options.height };
 
-    VkBuffer       stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+    arrsetlen(swapchainImages, options.framesInFlight);
+    arrsetlen(offscreenAllocations, options.framesInFlight);
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, size, 0, &data);
-    memcpy(data, vertices, size);
-    vkUnmapMemory(device, stagingBufferMemory);
+    for (uint32_t i = 0; i < options.framesInFlight; i++)
+    {
+        createImage(swapchainExtent.width, swapchainExtent.height, 1, swapchainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &swapchainImages[i], &offscreenAllocations[i]);
+    }
 
-    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertexBuffer, &vertexBufferMemory);
+    if (options.outputPath != NULL || options.hash)
+    {
+        createBuffer(swapchainExtent.width * swapchainExtent.height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, &readbackAllocation);
+    }
 
-    copyBuffer(stagingBuffer, vertexBuffer, size);
+    INFO("rendering headless to %ux%u %s targets\n", swapchainExtent.width, swapchainExtent.height, string_VkFormat(swapchainImageFormat));
+}
 
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);
+static void recordReadback(VkCommandBuffer commandBuffer, VkImage image)
+{
+    VkBufferImageCopy region               = { 0 };
+    region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount     = 1;
+    region.imageExtent.width               = swapchainExtent.width;
+    region.imageExtent.height              = swapchainExtent.height;
+    region.imageExtent.depth               = 1;
+
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+
+    VkBufferMemoryBarrier barrier          = { 0 };
+    barrier.sType                          = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask                  = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask                  = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex            = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex            = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer                         = readbackBuffer;
+    barrier.size                           = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
 }
 
+// FNV-1a, stable across runs and platforms so CI can compare frames against a known value
+static uint64_t hashBytes(const uint8_t *data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
 
-static inline void createIndexBuffer(void)
+static void writeReadback(void)
 {
-    VkDeviceSize size = sizeof(indices);
+    const uint8_t *pixels = readbackAllocation.mapped;
+    size_t         size   = (size_t) swapchainExtent.width * swapchainExtent.height * 4;
 
-    VkBuffer       stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+    if (options.hash) INFO("frame %llu hash: %016llx\n", (unsigned long long) frameNumber - 1, (unsigned long long) hashBytes(pixels, size));
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, size, 0, &data);
-    memcpy(data, indices, size);
-    vkUnmapMemory(device, stagingBufferMemory);
+    if (options.outputPath == NULL) return;
 
-    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
+    FILE *file = fopen(options.outputPath, "wb");
+    if (file == NULL)
+    {
+        ERROR("could not open %s for writing\n", options.outputPath);
+        return;
+    }
 
-    copyBuffer(stagingBuffer, indexBuffer, size);
+    fprintf(file, "P6\n%u %u\n255\n", swapchainExtent.width, swapchainExtent.height);
+    for (size_t i = 0; i < size; i += 4)
+    {
+        fwrite(&pixels[i], 3, 1, file);
+    }
+    fclose(file);
 
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);
+    INFO("wrote frame %llu to %s\n", (unsigned long long) frameNumber - 1, options.outputPath);
 }
 
-
-static inline void createUniformBuffers(void)
+static inline void destroyOffscreenTargets(void)
 {
-    VkDeviceSize size = sizeof(UniformBufferObject);
-
-    // TODO: merge to a single buffer with offsets
-    for (size_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    for (int i = 0; i < arrlen(swapchainImages); i++)
     {
-        createBuffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers[i], &uniformBufferMemories[i]);
-        vkMapMemory(device, uniformBufferMemories[i], 0, size, 0, &mappedUniformBuffers[i]);
+        destroyImage(swapchainImages[i], &offscreenAllocations[i]);
     }
+
+    arrfree(offscreenAllocations);
+    if (readbackBuffer != VK_NULL_HANDLE) destroyBuffer(readbackBuffer, &readbackAllocation);
 }
 
 
-static inline void createDescriptorPool(void)
+// returns the mask of valid timestamp bits for a queue family, 0 when it can't write timestamps
+static VkQueueFamilyProperties getQueueFamilyProperties(uint32_t familyIndex)
 {
-    VkDescriptorPoolSize poolSize         = { 0 };
-    poolSize.type                         = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount              = FRAMES_IN_FLIGHT;
+    uint32_t queueFamiliesCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamiliesCount, NULL);
 
-    VkDescriptorPoolCreateInfo createInfo = { 0 };
-    createInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    createInfo.poolSizeCount              = 1;
-    createInfo.pPoolSizes                 = &poolSize;
-    createInfo.maxSets                    = FRAMES_IN_FLIGHT;
+    VkQueueFamilyProperties *queueFamilies = NULL;
+    arrsetlen(queueFamilies, queueFamiliesCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamiliesCount, queueFamilies);
 
-    VK_TRY(vkCreateDescriptorPool(device, &createInfo, NULL, &descriptorPool), FATAL("could not create descriptor pool: %s\n", string_VkResult(result)));
-}
+    VkQueueFamilyProperties properties = queueFamilies[familyIndex];
+    arrfree(queueFamilies);
 
+    return properties;
+}
 
-static inline void allocateDescriptorSets(void)
+static uint64_t getTimestampMask(uint32_t familyIndex)
 {
-    // TODO: maybe try and optimize this? really doesn't matter though
-    VkDescriptorSetLayout layouts[FRAMES_IN_FLIGHT];
-    for (size_t i = 0; i < FRAMES_IN_FLIGHT; i++) layouts[i] = descriptorSetLayout;
+    uint32_t validBits = getQueueFamilyProperties(familyIndex).timestampValidBits;
 
-    VkDescriptorSetAllocateInfo allocInfo = { 0 };
-    allocInfo.sType                       = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool              = descriptorPool;
-    allocInfo.descriptorSetCount          = FRAMES_IN_FLIGHT;
-    allocInfo.pSetLayouts                 = layouts;
+    if (validBits == 0 || physicalDeviceProperties.limits.timestampPeriod == 0) return 0;
+    return validBits >= 64 ? UINT64_MAX : (1ULL << validBits) - 1;
+}
 
-    VK_TRY(vkAllocateDescriptorSets(device, &allocInfo, descriptorSets), FATAL("could not allocate descriptor sets: %s\n", string_VkResult(result)));
+static VkQueryPool createTimestampQueryPool(uint32_t queryCount)
+{
+    VkQueryPoolCreateInfo createInfo = { 0 };
+    createInfo.sType                 = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType             = VK_QUERY_TYPE_TIMESTAMP;
+    createInfo.queryCount            = queryCount;
 
-    for (size_t i = 0; i < FRAMES_IN_FLIGHT; i++)
-    {
-        VkDescriptorBufferInfo bufferInfo    = { 0 };
-        bufferInfo.buffer                    = uniformBuffers[i];
-        bufferInfo.offset                    = 0;
-        bufferInfo.range                     = sizeof(UniformBufferObject);
+    VkQueryPool queryPool;
+    VK_TRY(vkCreateQueryPool(device, &createInfo, NULL, &queryPool), FATAL("could not create timestamp query pool: %s\n", string_VkResult(result)));
 
-        VkWriteDescriptorSet writeDescriptor = { 0 };
-        writeDescriptor.sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writeDescriptor.dstSet               = descriptorSets[i];
-        writeDescriptor.dstBinding           = 0;
-        writeDescriptor.dstArrayElement      = 0;
-        writeDescriptor.descriptorType       = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        writeDescriptor.descriptorCount      = 1;
-        writeDescriptor.pBufferInfo          = &bufferInfo;
+    return queryPool;
+}
 
-        vkUpdateDescriptorSets(device, 1, &writeDescriptor, 0, NULL);
-    }
+// reads a begin/end timestamp pair without waiting, returns false if the GPU hasn't written it yet
+static bool readTimestampPair(VkQueryPool queryPool, uint32_t firstQuery, uint64_t mask, double *seconds)
+{
+    uint64_t timestamps[2];
+    if (vkGetQueryPoolResults(device, queryPool, firstQuery, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) return false;
+
+    *seconds = 1.0e-9 * physicalDeviceProperties.limits.timestampPeriod * ((timestamps[1] - timestamps[0]) & mask);
+    return true;
 }
 
 
-static inline void createSyncObjects(void)
+static void createUploadQueue(UploadQueue *queue, uint32_t familyIndex)
 {
+    queue->familyIndex    = familyIndex;
+    queue->nextToken      = 1;
+    queue->submittedToken = 0;
+    queue->completedToken = 0;
+    queue->current        = 0;
+
+    vkGetDeviceQueue(device, familyIndex, 0, &queue->queue);
+
+    VkCommandPoolCreateInfo poolCreateInfo   = { 0 };
+    poolCreateInfo.sType                     = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolCreateInfo.flags                     = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolCreateInfo.queueFamilyIndex          = familyIndex;
+
+    VK_TRY(vkCreateCommandPool(device, &poolCreateInfo, NULL, &queue->commandPool), FATAL("could not create upload command pool: %s\n", string_VkResult(result)));
+
+    // two timestamps per batch, transfer-only families are allowed to not support them at all,
+    // and can't reset queries even when they do, so those batches go untimed
+    VkQueueFamilyProperties properties = getQueueFamilyProperties(familyIndex);
+    bool canResetQueries       = properties.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    queue->timestampMask       = canResetQueries ? getTimestampMask(familyIndex) : 0;
+    queue->transferGranularity = properties.minImageTransferGranularity;
+    queue->queryPool     = queue->timestampMask != 0 ? createTimestampQueryPool(UPLOAD_BATCHES * 2) : VK_NULL_HANDLE;
+
+    VkCommandBufferAllocateInfo allocateInfo = { 0 };
+    allocateInfo.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.commandPool                 = queue->commandPool;
+    allocateInfo.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount          = 1;
+
     VkSemaphoreCreateInfo semaphoreCreateInfo = { 0 };
     semaphoreCreateInfo.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
     VkFenceCreateInfo fenceCreateInfo         = { 0 };
     fenceCreateInfo.sType                     = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceCreateInfo.flags                     = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+    for (int i = 0; i < UPLOAD_BATCHES; i++)
     {
-        VK_TRY(vkCreateSemaphore(device, &semaphoreCreateInfo, NULL, &imageAvailableSemaphores[i]), FATAL("could not create semaphore: %s\n", string_VkResult(result)));
-        VK_TRY(vkCreateSemaphore(device, &semaphoreCreateInfo, NULL, &renderFinishedSemaphores[i]), FATAL("could not create semaphore: %s\n", string_VkResult(result)));
-        VK_TRY(vkCreateFence(device, &fenceCreateInfo, NULL, &inFlightFences[i]), FATAL("could not create fence: %s\n", string_VkResult(result)));
+        UploadBatch *batch = &queue->batches[i];
+        *batch             = (UploadBatch){ 0 };
+
+        VK_TRY(vkAllocateCommandBuffers(device, &allocateInfo, &batch->commandBuffer), FATAL("could not allocate upload command buffer: %s\n", string_VkResult(result)));
+        VK_TRY(vkCreateSemaphore(device, &semaphoreCreateInfo, NULL, &batch->semaphore), FATAL("could not create upload semaphore: %s\n", string_VkResult(result)));
+        VK_TRY(vkCreateFence(device, &fenceCreateInfo, NULL, &batch->fence), FATAL("could not create upload fence: %s\n", string_VkResult(result)));
     }
 }
 
-
-static void cleanupSwapchain(void)
+static void destroyUploadQueue(UploadQueue *queue)
 {
-    for (int i = 0; i < arrlen(swapchainFramebuffers); i++)
+    for (int i = 0; i < UPLOAD_BATCHES; i++)
     {
-        vkDestroyFramebuffer(device, swapchainFramebuffers[i], NULL);
+        vkDestroySemaphore(device, queue->batches[i].semaphore, NULL);
+        vkDestroyFence(device, queue->batches[i].fence, NULL);
     }
 
-    for (int i = 0; i < arrlen(swapchainImageViews); i++)
-    {
-        vkDestroyImageView(device, swapchainImageViews[i], NULL);
-    }
+    arrfree(queue->pendingSemaphores);
+    if (queue->queryPool != VK_NULL_HANDLE) vkDestroyQueryPool(device, queue->queryPool, NULL);
+    vkDestroyCommandPool(device, queue->commandPool, NULL);
+}
+
+// accounts the GPU time of a finished batch towards the next frame's stats, once
+static void collectUploadTimestamps(UploadQueue *queue, UploadBatch *batch)
+{
+    if (!batch->timed) return;
 
-    vkDestroySwapchainKHR(device, swapchain, NULL);
+    double seconds;
+    if (!readTimestampPair(queue->queryPool, (batch - queue->batches) * 2, queue->timestampMask, &seconds)) return;
+
+    uploadGpuTime += seconds;
+    batch->timed   = false;
 }
 
-static void recreateSwapchain(void)
+// a batch's semaphore stays signalled until a frame waits on it, if no frame has by the time the slot is reused
+// an empty submit consumes it, so the next submit can signal it again and no frame waits on it twice
+static void consumeUploadSemaphore(UploadQueue *queue, UploadBatch *batch)
 {
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-    while (width == 0 || height == 0)
+    for (int i = 0; i < arrlen(queue->pendingSemaphores); i++)
     {
-        glfwWaitEvents();
-        glfwGetFramebufferSize(window, &width, &height);
-    }
+        if (queue->pendingSemaphores[i] != batch->semaphore) continue;
 
-    // FIXME: suboptimal: we are waiting for rendering to end to recreate the swapchain
-    //        see https://vulkan-tutorial.com/Drawing_a_triangle/Swap_chain_recreation (note under "Recreating the swap chain")
-    vkDeviceWaitIdle(device);
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
 
-    cleanupSwapchain();
+        VkSubmitInfo submitInfo        = { 0 };
+        submitInfo.sType               = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount  = 1;
+        submitInfo.pWaitSemaphores     = &batch->semaphore;
+        submitInfo.pWaitDstStageMask   = &waitStage;
 
-    createSwapchain();
-    createImageViews();
-    createFramebuffers();
+        VK_TRY(vkQueueSubmit(queue->queue, 1, &submitInfo, VK_NULL_HANDLE), FATAL("could not consume upload semaphore: %s\n", string_VkResult(result)));
 
-    INFO("recreated swapchain\n");
+        arrdel(queue->pendingSemaphores, i);
+        return;
+    }
 }
 
-
-static inline void updateUniformBuffer(uint32_t currentFrame)
+// returns the command buffer of the batch currently being recorded, starting a new batch if needed
+static VkCommandBuffer uploadCommandBuffer(UploadQueue *queue)
 {
-    static double angle = 0;
-    angle += deltaTime;
+    UploadBatch *batch = &queue->batches[queue->current];
+    if (batch->recording) return batch->commandBuffer;
 
-    UniformBufferObject ubo;
+    // the slot is being reused, its previous submission has to be done first
+    if (batch->token != 0)
+    {
+        VK_TRY(vkWaitForFences(device, 1, &batch->fence, VK_TRUE, UINT64_MAX), FATAL("could not wait for upload batch: %s\n", string_VkResult(result)));
+        if (batch->token > queue->completedToken) queue->completedToken = batch->token;
 
-    glm_mat4_identity(ubo.model);
-    glm_rotate(ubo.model, angle * glm_rad(90.0f), (vec3){ 0.0f, 0.0f, 1.0f });
+        collectUploadTimestamps(queue, batch);
+        consumeUploadSemaphore(queue, batch);
+    }
+
+    vkResetFences(device, 1, &batch->fence);
+    vkResetCommandBuffer(batch->commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo = { 0 };
+    beginInfo.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_TRY(vkBeginCommandBuffer(batch->commandBuffer, &beginInfo), FATAL("could not begin upload command buffer: %s\n", string_VkResult(result)));
 
-    glm_lookat((vec3){ 0.0f, 0.0f, 2.0f }, (vec3){ 0.0f, 0.0f, 0.0f }, (vec3){ 0.0f, 1.0f, 0.0f }, ubo.view);
+    batch->token     = queue->nextToken;
+    batch->recording = true;
 
-    glm_perspective(glm_rad(45.0f), (float) swapchainExtent.width / (float) swapchainExtent.height, 0.1f, 10.0f, ubo.proj);
+    if (queue->queryPool != VK_NULL_HANDLE)
+    {
+        uint32_t query = queue->current * 2;
+        vkCmdResetQueryPool(batch->commandBuffer, queue->queryPool, query, 2);
+        vkCmdWriteTimestamp(batch->commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queue->queryPool, query);
+    }
 
-    memcpy(mappedUniformBuffers[currentFrame], &ubo, sizeof(ubo));
+    return batch->commandBuffer;
 }
 
-static inline void drawFrame(void)
+// token of the batch currently being recorded, i.e. the one that will carry any copy recorded now
+static inline uint64_t uploadPendingToken(UploadQueue *queue)
 {
-    VkCommandBuffer commandBuffer           = commandBuffers[currentFrame];
-    VkFence         inFlightFence           = inFlightFences[currentFrame];
-    VkSemaphore     imageAvailableSemaphore = imageAvailableSemaphores[currentFrame];
-    VkSemaphore     renderFinishedSemaphore = renderFinishedSemaphores[currentFrame];
+    return queue->nextToken;
+}
 
-    vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+// submits everything recorded so far in one go and returns the token that completes with it
+static uint64_t uploadSubmit(UploadQueue *queue)
+{
+    UploadBatch *batch = &queue->batches[queue->current];
+    if (!batch->recording) return queue->submittedToken;
 
-    uint32_t imageIndex;
-    VK_TRY(vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex), {
-        if (result == VK_ERROR_OUT_OF_DATE_KHR)
-        {
-            recreateSwapchain();
-            return;
+    if (queue->queryPool != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(batch->commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queue->queryPool, queue->current * 2 + 1);
+        batch->timed = true;
+    }
+
+    VK_TRY(vkEndCommandBuffer(batch->commandBuffer), FATAL("could not record upload command buffer: %s\n", string_VkResult(result)));
+
+    VkSubmitInfo submitInfo         = { 0 };
+    submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount   = 1;
+    submitInfo.pCommandBuffers      = &batch->commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores    = &batch->semaphore;
+
+    VK_TRY(vkQueueSubmit(queue->queue, 1, &submitInfo, batch->fence), FATAL("could not submit upload batch: %s\n", string_VkResult(result)));
+
+    // the next frame makes the GPU wait on this instead of the CPU waiting for the queue to go idle
+    arrput(queue->pendingSemaphores, batch->semaphore);
+
+    batch->recording      = false;
+    queue->submittedToken = batch->token;
+    queue->nextToken++;
+    queue->current        = (queue->current + 1) % UPLOAD_BATCHES;
+
+    return batch->token;
+}
+
+static bool uploadIsComplete(UploadQueue *queue, uint64_t token)
+{
+    if (token <= queue->completedToken) return true;
+    if (token > queue->submittedToken)  return false;
+
+    for (int i = 0; i < UPLOAD_BATCHES; i++)
+    {
+        UploadBatch *batch = &queue->batches[i];
+        if (batch->token != token) continue;
+
+        if (vkGetFenceStatus(device, batch->fence) != VK_SUCCESS) return false;
+
+        // batches on one queue retire in submission order
+        queue->completedToken = token;
+        collectUploadTimestamps(queue, batch);
+        return true;
+    }
+
+    // the batch slot was already recycled, which only happens after waiting on it
+    return true;
+}
+
+static void uploadWait(UploadQueue *queue, uint64_t token)
+{
+    if (token > queue->submittedToken) uploadSubmit(queue);
+    if (uploadIsComplete(queue, token)) return;
+
+    for (int i = 0; i < UPLOAD_BATCHES; i++)
+    {
+        UploadBatch *batch = &queue->batches[i];
+        if (batch->token != token) continue;
+
+        VK_TRY(vkWaitForFences(device, 1, &batch->fence, VK_TRUE, UINT64_MAX), FATAL("could not wait for upload batch: %s\n", string_VkResult(result)));
+        queue->completedToken = token;
+        collectUploadTimestamps(queue, batch);
+        return;
+    }
+}
+
+
+static inline void createStagingRing(void)
+{
+    createBuffer(STAGING_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingRingBuffer, &stagingRingAllocation);
+}
+
+// frees regions whose uploads have finished; head and tail only ever grow, the ring offset is their value modulo the size
+static void stagingRingReclaim(bool wait)
+{
+    while (arrlen(stagingRegions) > 0)
+    {
+        StagingRegion region = stagingRegions[0];
+
+        if (wait) uploadWait(region.queue, region.token);
+        else if (!uploadIsComplete(region.queue, region.token)) break;
+
+        stagingRingTail = region.end;
+        arrdel(stagingRegions, 0);
+
+        // one region is enough to make progress when blocking
+        if (wait) break;
+    }
+}
+
+static void *stagingRingAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+{
+    if (size > STAGING_RING_SIZE) FATAL("upload of %llu B does not fit in the staging ring (%u B)\n", (unsigned long long) size, STAGING_RING_SIZE);
+
+    stagingRingReclaim(false);
+
+    VkDeviceSize start = ALIGN_UP(stagingRingHead, alignment);
+    // never split an upload across the end of the ring
+    if (start % STAGING_RING_SIZE + size > STAGING_RING_SIZE) start = ALIGN_UP(stagingRingHead, STAGING_RING_SIZE);
+
+    while (start + size - stagingRingTail > STAGING_RING_SIZE) stagingRingReclaim(true);
+
+    stagingRingHead = start + size;
+
+    *offset = start % STAGING_RING_SIZE;
+    return (char *)stagingRingAllocation.mapped + *offset;
+}
+
+static inline void destroyStagingRing(void)
+{
+    while (arrlen(stagingRegions) > 0) stagingRingReclaim(true);
+    arrfree(stagingRegions);
+
+    destroyBuffer(stagingRingBuffer, &stagingRingAllocation);
+}
+
+// reserves staging memory for data that a command recorded into the queue's current batch will read
+static void *uploadStage(UploadQueue *queue, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+{
+    void *data = stagingRingAllocate(size, alignment, offset);
+
+    uploadCommandBuffer(queue);
+    uint64_t token = uploadPendingToken(queue);
+
+    StagingRegion *last = arrlen(stagingRegions) > 0 ? &arrlast(stagingRegions) : NULL;
+    if (last != NULL && last->queue == queue && last->token == token) last->end = stagingRingHead;
+    else arrput(stagingRegions, ((StagingRegion){ .queue = queue, .token = token, .end = stagingRingHead }));
+
+    return data;
+}
+
+static void copyBuffer(UploadQueue *queue, VkBuffer src, VkDeviceSize srcOffset, VkBuffer dst, VkDeviceSize dstOffset, VkDeviceSize size)
+{
+    VkBufferCopy copyRegion = { 0 };
+    copyRegion.srcOffset    = srcOffset;
+    copyRegion.dstOffset    = dstOffset;
+    copyRegion.size         = size;
+
+    vkCmdCopyBuffer(uploadCommandBuffer(queue), src, dst, 1, &copyRegion);
+}
+
+// large buffers go through the ring in pieces, so they never need to fit in it at once
+static void uploadBuffer(UploadQueue *queue, VkBuffer dst, VkDeviceSize dstOffset, const void *data, VkDeviceSize size)
+{
+    for (VkDeviceSize copied = 0; copied < size;)
+    {
+        VkDeviceSize chunkSize = size - copied < STAGING_RING_SIZE / 4 ? size - copied : STAGING_RING_SIZE / 4;
+
+        VkDeviceSize stagingOffset;
+        memcpy(uploadStage(queue, chunkSize, 4, &stagingOffset), (const char *)data + copied, chunkSize);
+
+        copyBuffer(queue, stagingRingBuffer, stagingOffset, dst, dstOffset + copied, chunkSize);
+        copied += chunkSize;
+    }
+}
+
+static uint32_t getCpuCount(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? count : 1;
+#endif
+}
+
+// pulls images off the loader until none are left, stb_image keeps its failure reason thread local
+static void *textureDecodeWorker(void *argument)
+{
+    TextureLoader *loader = argument;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&loader->mutex);
+        uint32_t index = loader->next < loader->count ? loader->next++ : UINT32_MAX;
+        pthread_mutex_unlock(&loader->mutex);
+
+        if (index == UINT32_MAX) return NULL;
+
+        TextureDecode *decode = &loader->decodes[index];
+        double         start  = getTime();
+
+        AssetView file;
+        if (mapAsset(decode->path, &file))
+        {
+            decode->fileSize = file.size;
+
+            uint32_t magic = 0;
+            if (file.size >= sizeof(magic)) memcpy(&magic, file.data, sizeof(magic));
+
+            if (magic == COOKED_TEXTURE_MAGIC)
+            {
+                if (validateCookedTexture(file.data, file.size))
+                {
+                    const CookedTextureHeader *header = file.data;
+                    decode->width  = header->width;
+                    decode->height = header->height;
+                    decode->cooked = file;
+                }
+                else
+                {
+                    ERROR("%s is not a valid cooked texture\n", decode->path);
+                    unmapAsset(&file);
+                }
+            }
+            else
+            {
+                int channels;
+                decode->pixels = stbi_load_from_memory(file.data, (int)file.size, &decode->width, &decode->height, &channels, STBI_rgb_alpha);
+                if (decode->pixels == NULL) ERROR("could not decode %s: %s\n", decode->path, stbi_failure_reason());
+                unmapAsset(&file);
+            }
+        }
+
+        decode->decodeTime = getTime() - start;
+
+        pthread_mutex_lock(&loader->mutex);
+        arrput(loader->finished, index);
+        pthread_cond_signal(&loader->decoded);
+        pthread_mutex_unlock(&loader->mutex);
+    }
+}
+
+static void imageBarrier(VkCommandBuffer commandBuffer, VkImage image, uint32_t baseMipLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout,
+                         VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+    VkImageMemoryBarrier barrier            = { 0 };
+    barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout                       = oldLayout;
+    barrier.newLayout                       = newLayout;
+    barrier.srcAccessMask                   = srcAccess;
+    barrier.dstAccessMask                   = dstAccess;
+    barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image                           = image;
+    barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel   = baseMipLevel;
+    barrier.subresourceRange.levelCount     = levelCount;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount     = 1;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+// like uploadBuffer, a level goes through the staging ring in runs of rows so it never needs to fit in it at once,
+// the image is expected in TRANSFER_DST_OPTIMAL
+static void uploadTextureLevel(UploadQueue *queue, Texture *texture, VkFormat format, uint32_t level, const void *data)
+{
+    // block compressed levels are split between rows of blocks
+    uint32_t     blockHeight = blockFormatSize(format) != 0 ? 4 : 1;
+    uint32_t     width       = mipExtent(texture->width, level);
+    uint32_t     height      = mipExtent(texture->height, level);
+    VkDeviceSize rowSize     = textureLevelSize(format, width, blockHeight);
+    uint32_t     levelRows   = (height + blockHeight - 1) / blockHeight;
+    uint32_t     chunkRows   = STAGING_RING_SIZE / 4 / rowSize;
+    uint32_t     granularity = queue->transferGranularity.height;
+
+    // chunks start on the queue's granularity, which compressed formats count in blocks, a zero granularity takes the level whole
+    if (granularity == 0) chunkRows = levelRows;
+    else chunkRows = chunkRows / granularity * granularity > 0 ? chunkRows / granularity * granularity : granularity;
+
+    for (uint32_t y = 0; y < height; y += chunkRows * blockHeight)
+    {
+        uint32_t     rows      = levelRows - y / blockHeight < chunkRows ? levelRows - y / blockHeight : chunkRows;
+        VkDeviceSize chunkSize = rows * rowSize;
+
+        VkDeviceSize stagingOffset;
+        memcpy(uploadStage(queue, chunkSize, COOKED_TEXTURE_ALIGNMENT, &stagingOffset), (const char *)data + y / blockHeight * rowSize, chunkSize);
+
+        VkBufferImageCopy region           = { 0 };
+        region.bufferOffset                = stagingOffset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel   = level;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset                 = (VkOffset3D){ 0, y, 0 };
+        region.imageExtent                 = (VkExtent3D){ width, rows * blockHeight < height - y ? rows * blockHeight : height - y, 1 };
+        vkCmdCopyBufferToImage(uploadCommandBuffer(queue), stagingRingBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    }
+}
+
+static bool canBlitMipmaps(VkFormat format)
+{
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & required) == required;
+}
+
+// copies level 0 and blits each level from the previous one, all on the graphics queue
+static void uploadTextureBlit(Texture *texture, const stbi_uc *pixels)
+{
+    imageBarrier(uploadCommandBuffer(&graphicsUploads), texture->image, 0, texture->mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    uploadTextureLevel(&graphicsUploads, texture, VK_FORMAT_R8G8B8A8_SRGB, 0, pixels);
+
+    // staging may have submitted the batch the copies started in
+    VkCommandBuffer commandBuffer = uploadCommandBuffer(&graphicsUploads);
+
+    for (uint32_t level = 1; level < texture->mipLevels; level++)
+    {
+        imageBarrier(commandBuffer, texture->image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+        VkImageBlit blit                   = { 0 };
+        blit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel       = level - 1;
+        blit.srcSubresource.layerCount     = 1;
+        blit.srcOffsets[1]                 = (VkOffset3D){ mipExtent(texture->width, level - 1), mipExtent(texture->height, level - 1), 1 };
+        blit.dstSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel       = level;
+        blit.dstSubresource.layerCount     = 1;
+        blit.dstOffsets[1]                 = (VkOffset3D){ mipExtent(texture->width, level), mipExtent(texture->height, level), 1 };
+        vkCmdBlitImage(commandBuffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        imageBarrier(commandBuffer, texture->image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    imageBarrier(commandBuffer, texture->image, texture->mipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+// copies a prepared mip chain from `data`, level i starting at `offsets[i]`, on the transfer queue
+static void uploadTextureLevels(Texture *texture, VkFormat format, const void *data, const VkDeviceSize *offsets)
+{
+    imageBarrier(uploadCommandBuffer(&transferUploads), texture->image, 0, texture->mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    for (uint32_t level = 0; level < texture->mipLevels; level++) uploadTextureLevel(&transferUploads, texture, format, level, (const char *)data + offsets[level]);
+
+    // the transfer queue can't name the fragment stage, the upload semaphore waited on by the frame makes the writes visible
+    imageBarrier(uploadCommandBuffer(&transferUploads), texture->image, 0, texture->mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+}
+
+// the mip chain is filtered on the CPU instead, in system memory since reading back from the write-combined staging ring would be slow
+static void uploadTextureCpuMips(Texture *texture, const stbi_uc *pixels)
+{
+    VkDeviceSize  size    = 0;
+    VkDeviceSize *offsets = NULL;
+
+    for (uint32_t level = 0; level < texture->mipLevels; level++)
+    {
+        arrput(offsets, size);
+        size += ALIGN_UP(textureLevelSize(VK_FORMAT_R8G8B8A8_SRGB, mipExtent(texture->width, level), mipExtent(texture->height, level)), COOKED_TEXTURE_ALIGNMENT);
+    }
+
+    uint8_t *chain = malloc(size);
+    memcpy(chain, pixels, (size_t)texture->width * texture->height * 4);
+    for (uint32_t level = 1; level < texture->mipLevels; level++)
+    {
+        downsampleRgba8(chain + offsets[level - 1], mipExtent(texture->width, level - 1), mipExtent(texture->height, level - 1),
+                        chain + offsets[level], mipExtent(texture->width, level), mipExtent(texture->height, level), true);
+    }
+
+    uploadTextureLevels(texture, VK_FORMAT_R8G8B8A8_SRGB, chain, offsets);
+
+    free(chain);
+    arrfree(offsets);
+}
+
+static void uploadTexture(Texture *texture, const stbi_uc *pixels)
+{
+    VkFormat format    = VK_FORMAT_R8G8B8A8_SRGB;
+    bool     blit      = canBlitMipmaps(format);
+    texture->mipLevels = mipLevelCount(texture->width, texture->height);
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | (blit ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0);
+    createImage(texture->width, texture->height, texture->mipLevels, format, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texture->image, &texture->allocation);
+
+    if (blit) uploadTextureBlit(texture, pixels);
+    else uploadTextureCpuMips(texture, pixels);
+
+    texture->view = createImageView(texture->image, format, VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->mipLevels);
+}
+
+// cooked mip chains are already in their final format, so the mapped file is copied into the staging ring as is
+static void uploadCookedTexture(Texture *texture, const AssetView *file)
+{
+    CookedTextureHeader header;
+    memcpy(&header, file->data, sizeof(header));
+
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, header.format, &properties);
+    if (!(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) FATAL("device can't sample cooked texture format %s\n", string_VkFormat(header.format));
+
+    texture->mipLevels = header.mipLevels;
+
+    createImage(texture->width, texture->height, texture->mipLevels, header.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texture->image, &texture->allocation);
+
+    CookedTextureLevel *levels = NULL;
+    arrsetlen(levels, header.mipLevels);
+    memcpy(levels, (const char *)file->data + sizeof(header), header.mipLevels * sizeof(CookedTextureLevel));
+
+    VkDeviceSize *offsets = NULL;
+    for (uint32_t i = 0; i < header.mipLevels; i++) arrput(offsets, levels[i].offset);
+
+    uploadTextureLevels(texture, header.format, file->data, offsets);
+
+    arrfree(offsets);
+    arrfree(levels);
+
+    texture->view = createImageView(texture->image, header.format, VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->mipLevels);
+}
+
+static inline void createTextureSampler(void)
+{
+    VkSamplerCreateInfo createInfo     = { 0 };
+    createInfo.sType                   = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    createInfo.magFilter               = VK_FILTER_LINEAR;
+    createInfo.minFilter               = VK_FILTER_LINEAR;
+    createInfo.mipmapMode              = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    createInfo.addressModeU            = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    createInfo.addressModeV            = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    createInfo.addressModeW            = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    createInfo.anisotropyEnable        = VK_FALSE;
+    createInfo.borderColor             = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    createInfo.unnormalizedCoordinates = VK_FALSE;
+    createInfo.compareEnable           = VK_FALSE;
+    createInfo.compareOp               = VK_COMPARE_OP_ALWAYS;
+    createInfo.minLod                  = 0.0f;
+    createInfo.maxLod                  = VK_LOD_CLAMP_NONE;
+
+    VK_TRY(vkCreateSampler(device, &createInfo, NULL, &textureSampler), FATAL("could not create texture sampler: %s\n", string_VkResult(result)));
+}
+
+// decodes every texture on worker threads while this thread streams finished ones into the staging ring in completion order
+static inline void createTextureImages(void)
+{
+    uint32_t count = arrlen(options.texturePaths);
+
+    TextureLoader loader = { 0 };
+    loader.count         = count;
+    arrsetlen(loader.decodes, count);
+    for (uint32_t i = 0; i < count; i++) loader.decodes[i] = (TextureDecode){ .path = options.texturePaths[i] };
+
+    pthread_mutex_init(&loader.mutex, NULL);
+    pthread_cond_init(&loader.decoded, NULL);
+
+    uint32_t threadCount = options.loaderThreads != 0 ? options.loaderThreads : getCpuCount();
+    if (threadCount > count) threadCount = count;
+
+    double start = getTime();
+
+    pthread_t *threads = NULL;
+    arrsetlen(threads, threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        if (pthread_create(&threads[i], NULL, textureDecodeWorker, &loader) != 0) FATAL("could not create texture decode thread\n");
+    }
+
+    arrsetlen(textures, count);
+    memset(textures, 0, count * sizeof(Texture));
+
+    size_t fileBytes    = 0;
+    size_t decodedBytes = 0;
+
+    for (uint32_t uploaded = 0; uploaded < count; uploaded++)
+    {
+        pthread_mutex_lock(&loader.mutex);
+        while (arrlen(loader.finished) == 0) pthread_cond_wait(&loader.decoded, &loader.mutex);
+        uint32_t index = arrpop(loader.finished);
+        pthread_mutex_unlock(&loader.mutex);
+
+        TextureDecode *decode = &loader.decodes[index];
+        if (decode->pixels == NULL && decode->cooked.data == NULL) FATAL("could not load texture %s\n", decode->path);
+
+        textures[index].width  = decode->width;
+        textures[index].height = decode->height;
+
+        if (decode->cooked.data != NULL)
+        {
+            uploadCookedTexture(&textures[index], &decode->cooked);
+            unmapAsset(&decode->cooked);
+            decodedBytes += decode->fileSize;
         }
+        else
+        {
+            uploadTexture(&textures[index], decode->pixels);
+            stbi_image_free(decode->pixels);
+            decode->pixels = NULL;
+            decodedBytes += (size_t)decode->width * decode->height * 4;
+        }
+
+        fileBytes += decode->fileSize;
+
+        LOG("decoded %s (%dx%d) in %.3f ms\n", decode->path, decode->width, decode->height, 1000 * decode->decodeTime);
+    }
+
+    for (uint32_t i = 0; i < threadCount; i++) pthread_join(threads[i], NULL);
+
+    double elapsed = getTime() - start;
+    INFO("loaded %u textures in %.3f ms on %u threads: %.1f MB/s read, %.1f MB/s decoded\n",
+         count, 1000 * elapsed, threadCount, fileBytes / elapsed / 1.0e6, decodedBytes / elapsed / 1.0e6);
+
+    arrfree(threads);
+    arrfree(loader.finished);
+    arrfree(loader.decodes);
+    pthread_cond_destroy(&loader.decoded);
+    pthread_mutex_destroy(&loader.mutex);
+}
+
+
+static void createMeshBuffers(const void *vertexData, VkDeviceSize vertexSize, const void *indexData, VkDeviceSize indexSize)
+{
+    createBuffer(vertexSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh.vertexBuffer, &mesh.vertexAllocation);
+    createBuffer(indexSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh.indexBuffer, &mesh.indexAllocation);
+
+    uploadBuffer(&transferUploads, mesh.vertexBuffer, 0, vertexData, vertexSize);
+    uploadBuffer(&transferUploads, mesh.indexBuffer, 0, indexData, indexSize);
+}
+
+static inline void createBuiltinMesh(void)
+{
+    mesh.indexType    = VK_INDEX_TYPE_UINT16;
+    mesh.vertexStride = sizeof(Vertex);
+    memcpy(mesh.attributes, vertexLayout, sizeof(vertexLayout));
+    glm_vec3_one(mesh.positionScale);
+    glm_vec3_zero(mesh.positionBias);
+    arrput(mesh.submeshes, ((MeshSubmesh){ .indexCount = ARR_LEN(indices), .boundsMin = { -0.5f, -0.5f, 0.0f }, .boundsMax = { 0.5f, 0.5f, 0.0f } }));
+
+    createMeshBuffers(vertices, sizeof(vertices), indices, sizeof(indices));
+}
+
+// the file is mapped and its vertex and index data copied straight into the staging ring, nothing is parsed
+static inline void createMesh(void)
+{
+    if (options.meshPath == NULL)
+    {
+        createBuiltinMesh();
+        return;
+    }
+
+    double start = getTime();
+
+    AssetView file;
+    if (!mapAsset(options.meshPath, &file)) FATAL("could not load mesh %s\n", options.meshPath);
+    if (!validateMesh(file.data, file.size)) FATAL("%s is not a valid mesh\n", options.meshPath);
+
+    MeshHeader header;
+    memcpy(&header, file.data, sizeof(header));
+
+    // the shaders read every attribute, the pipeline's vertex input is built from whatever formats the mesh stores them in
+    for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++)
+    {
+        if (header.attributes[i].format == VK_FORMAT_UNDEFINED) FATAL("%s has no %s attribute\n", options.meshPath, vertexAttributeNames[i]);
+
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, header.attributes[i].format, &properties);
+        if (!(properties.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT)) FATAL("%s stores its %s as %s, which the device can't fetch\n", options.meshPath, vertexAttributeNames[i], string_VkFormat(header.attributes[i].format));
+    }
+
+    // indices are compared against the limit before vertexOffset is added, meshes cooked with 16-bit chunks never get near it
+    if (header.indexType == VK_INDEX_TYPE_UINT32 && header.vertexCount - 1 > physicalDeviceProperties.limits.maxDrawIndexedIndexValue)
+    {
+        FATAL("%s indexes %u vertices but the device stops at %u, cook it with --index-type 16\n", options.meshPath, header.vertexCount, physicalDeviceProperties.limits.maxDrawIndexedIndexValue + 1);
+    }
+
+    mesh.indexType    = header.indexType;
+    mesh.vertexStride = header.vertexStride;
+    memcpy(mesh.attributes, header.attributes, sizeof(header.attributes));
+    memcpy(mesh.positionScale, header.positionScale, sizeof(header.positionScale));
+    memcpy(mesh.positionBias, header.positionBias, sizeof(header.positionBias));
+
+    arrsetlen(mesh.submeshes, header.submeshCount);
+    memcpy(mesh.submeshes, (const char *)file.data + sizeof(header), header.submeshCount * sizeof(MeshSubmesh));
+
+    VkDeviceSize vertexSize = (VkDeviceSize) header.vertexCount * header.vertexStride;
+    VkDeviceSize indexSize  = (VkDeviceSize) header.indexCount * indexTypeSize(header.indexType);
+    createMeshBuffers((const char *)file.data + header.vertexDataOffset, vertexSize, (const char *)file.data + header.indexDataOffset, indexSize);
+
+    unmapAsset(&file);
+
+    double elapsed = getTime() - start;
+    INFO("loaded mesh %s (%u vertices of %u B, %u %u-bit indices, %u submeshes) in %.3f ms: %.1f MB/s\n",
+         options.meshPath, header.vertexCount, header.vertexStride, header.indexCount, 8 * indexTypeSize(header.indexType), header.submeshCount, 1000 * elapsed,
+         (vertexSize + indexSize) / elapsed / 1.0e6);
+}
+
+static inline void destroyMesh(void)
+{
+    destroyBuffer(mesh.vertexBuffer, &mesh.vertexAllocation);
+    destroyBuffer(mesh.indexBuffer, &mesh.indexAllocation);
+    arrfree(mesh.submeshes);
+}
+
+static int compareInstanceDistances(const void *a, const void *b)
+{
+    // cglm takes mutable vectors, the models are only read
+    float x = glm_vec3_distance2(cameraEye, ((Instance *)a)->model[3]);
+    float y = glm_vec3_distance2(cameraEye, ((Instance *)b)->model[3]);
+    return (x > y) - (x < y);
+}
+
+// the first `count` instances in distance order leave this many in `group`
+static inline uint32_t groupInstanceCount(uint32_t count, uint32_t group)
+{
+    return count > group ? (count - group + instanceGroups - 1) / instanceGroups : 0;
+}
+
+static inline uint32_t groupFirstInstance(uint32_t group)
+{
+    uint32_t size  = arrlen(instances) / instanceGroups;
+    uint32_t extra = arrlen(instances) % instanceGroups;
+    return group * size + (group < extra ? group : extra);
+}
+
+// lays the instances out on a square grid scaled to the space a single mesh takes, so one instance is drawn as before
+static inline void createInstances(void)
+{
+    uint32_t side = (uint32_t) ceil(sqrt(options.instances));
+    float    cell = 1.0f / side;
+
+    arrsetlen(instances, options.instances);
+    for (uint32_t i = 0; i < options.instances; i++)
+    {
+        vec3 offset = { ((i % side) + 0.5f) * cell - 0.5f, ((i / side) + 0.5f) * cell - 0.5f, 0.0f };
+
+        glm_translate_make(instances[i].model, offset);
+        glm_scale_uni(instances[i].model, cell);
+    }
+
+    // front to back so early depth testing rejects more of the later instances' fragments, and = and - keep the nearest ones
+    qsort(instances, options.instances, sizeof(Instance), compareInstanceDistances);
+
+    instanceGroups        = arrlen(textures) < options.instances ? arrlen(textures) : options.instances;
+    instanceGroupCapacity = groupInstanceCount(options.instances, 0);
+
+    // dealing in distance order keeps each group front to back
+    Instance *grouped = NULL;
+    arrsetlen(grouped, options.instances);
+    for (uint32_t i = 0; i < options.instances; i++) grouped[groupFirstInstance(i % instanceGroups) + i / instanceGroups] = instances[i];
+    arrfree(instances);
+    instances = grouped;
+
+    VkDeviceSize size = options.instances * sizeof(Instance);
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &instanceBuffer, &instanceBufferAllocation);
+
+    uploadBuffer(&transferUploads, instanceBuffer, 0, instances, size);
+
+    INFO("drawing %u instances with %u textures and %d submeshes\n", options.instances, instanceGroups, (int) arrlen(mesh.submeshes));
+}
+
+static void setDrawInstanceCount(uint32_t count)
+{
+    drawInstanceCount = count < 1 ? 1 : count > arrlen(instances) ? arrlen(instances) : count;
+
+    for (int i = 0; i < arrlen(drawList); i++) drawList[i].instanceCount = groupInstanceCount(drawInstanceCount, i / arrlen(mesh.submeshes));
+    for (uint32_t i = 0; i < options.framesInFlight; i++) drawListDirty[i] = true;
+}
+
+static inline void createDrawList(void)
+{
+    // grouped by instance group so each group's draws are consecutive
+    uint32_t submeshCount = arrlen(mesh.submeshes);
+    arrsetlen(drawList, instanceGroups * submeshCount);
+    for (int i = 0; i < arrlen(drawList); i++)
+    {
+        MeshSubmesh *submesh      = &mesh.submeshes[i % submeshCount];
+        drawList[i].indexCount    = submesh->indexCount;
+        drawList[i].firstIndex    = submesh->firstIndex;
+        drawList[i].vertexOffset  = submesh->vertexOffset;
+        // the cull pass finds a group's instances through it, without culling the group's instance buffer offset does instead,
+        // since culling is only off when a nonzero firstInstance is unsupported
+        drawList[i].firstInstance = cullingEnabled ? groupFirstInstance(i / submeshCount) : 0;
+    }
+
+    VkDeviceSize size = arrlen(drawList) * sizeof(VkDrawIndexedIndirectCommand);
+
+    vec4 *bounds = NULL;
+    arrsetlen(bounds, arrlen(drawList));
+    for (int i = 0; i < arrlen(drawList); i++)
+    {
+        vec3 boundsMin, boundsMax;
+        glm_vec3_copy(mesh.submeshes[i % submeshCount].boundsMin, boundsMin);
+        glm_vec3_copy(mesh.submeshes[i % submeshCount].boundsMax, boundsMax);
+
+        glm_vec3_center(boundsMin, boundsMax, bounds[i]);
+        bounds[i][3] = glm_vec3_distance(boundsMin, boundsMax) / 2.0f;
+    }
+
+    createBuffer(arrlen(bounds) * sizeof(vec4), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &drawBoundsBuffer, &drawBoundsAllocation);
+    uploadBuffer(&transferUploads, drawBoundsBuffer, 0, bounds, arrlen(bounds) * sizeof(vec4));
+    arrfree(bounds);
+
+    arrsetlen(drawListDirty, options.framesInFlight);
+    arrsetlen(indirectBuffers, options.framesInFlight);
+    arrsetlen(indirectBufferAllocations, options.framesInFlight);
+
+    for (uint32_t i = 0; i < options.framesInFlight; i++)
+    {
+        // the cull pass reads it as the draws to test when culling is enabled
+        createBuffer(size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indirectBuffers[i], &indirectBufferAllocations[i]);
+    }
+
+    setDrawInstanceCount(arrlen(instances));
+
+    INFO("draw list: %d indirect draws, %s\n", (int) arrlen(drawList), multiDrawIndirect ? "issued as one multi-draw per texture" : "multi-draw indirect is unsupported, issued one by one");
+}
+
+// the frame's fence has been waited on, so its indirect buffer is no longer read
+static inline void updateDrawList(uint32_t frame)
+{
+    if (!drawListDirty[frame]) return;
+
+    memcpy(indirectBufferAllocations[frame].mapped, drawList, arrlen(drawList) * sizeof(VkDrawIndexedIndirectCommand));
+    drawListDirty[frame] = false;
+}
+
+static inline void destroyDrawList(void)
+{
+    for (uint32_t i = 0; i < options.framesInFlight; i++) destroyBuffer(indirectBuffers[i], &indirectBufferAllocations[i]);
+    destroyBuffer(drawBoundsBuffer, &drawBoundsAllocation);
+
+    arrfree(drawList);
+    arrfree(drawListDirty);
+    arrfree(indirectBuffers);
+    arrfree(indirectBufferAllocations);
+}
+
+
+static const VkDescriptorType cullBindings[] = {
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,          // ubo
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // instances
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // draw list
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // draw bounds
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // culled draws
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // culled instances
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // stats
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,          // occluded flags
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER   // depth pyramid
+};
+
+static const VkDescriptorType depthPyramidBindings[] = {
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,  // depth buffer or the level below
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE            // level being built
+};
+
+static void createComputePipeline(const char *path, const VkDescriptorType *bindings, uint32_t bindingCount, uint32_t pushConstantsSize,
+                                  VkDescriptorSetLayout *setLayout, VkPipelineLayout *layout, VkPipeline *pipeline)
+{
+    VkDescriptorSetLayoutBinding *layoutBindings = NULL;
+    arrsetlen(layoutBindings, bindingCount);
+    for (uint32_t i = 0; i < bindingCount; i++)
+    {
+        layoutBindings[i]                          = (VkDescriptorSetLayoutBinding){ 0 };
+        layoutBindings[i].binding                  = i;
+        layoutBindings[i].descriptorType           = bindings[i];
+        layoutBindings[i].descriptorCount          = 1;
+        layoutBindings[i].stageFlags               = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    {
+        VkDescriptorSetLayoutCreateInfo createInfo = { 0 };
+        createInfo.sType                           = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        createInfo.bindingCount                    = bindingCount;
+        createInfo.pBindings                       = layoutBindings;
+
+        VK_TRY(vkCreateDescriptorSetLayout(device, &createInfo, NULL, setLayout), FATAL("could not create descriptor set layout for %s: %s\n", path, string_VkResult(result)));
+    }
+    arrfree(layoutBindings);
+
+    {
+        VkPushConstantRange pushConstants     = { 0 };
+        pushConstants.stageFlags              = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstants.offset                  = 0;
+        pushConstants.size                    = pushConstantsSize;
+
+        VkPipelineLayoutCreateInfo createInfo = { 0 };
+        createInfo.sType                      = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        createInfo.setLayoutCount             = 1;
+        createInfo.pSetLayouts                = setLayout;
+        createInfo.pushConstantRangeCount     = 1;
+        createInfo.pPushConstantRanges        = &pushConstants;
+
+        VK_TRY(vkCreatePipelineLayout(device, &createInfo, NULL, layout), FATAL("could not create pipeline layout for %s: %s\n", path, string_VkResult(result)));
+    }
+
+    VkShaderModule computeShader = createShaderModule(path);
+
+    VkComputePipelineCreateInfo createInfo = { 0 };
+    createInfo.sType                       = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    createInfo.stage.sType                 = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    createInfo.stage.stage                 = VK_SHADER_STAGE_COMPUTE_BIT;
+    createInfo.stage.module                = computeShader;
+    createInfo.stage.pName                 = "main";
+    createInfo.layout                      = *layout;
+
+    double start = getTime();
+    VK_TRY(vkCreateComputePipelines(device, pipelineCache, 1, &createInfo, NULL, pipeline), FATAL("could not create compute pipeline for %s: %s\n", path, string_VkResult(result)));
+    LOG("created compute pipeline %s in %.3f ms\n", path, 1000 * (getTime() - start));
+
+    vkDestroyShaderModule(device, computeShader, NULL);
+}
+
+// the sets reference the depth pyramid, so they are allocated again whenever it is recreated
+static void createCullDescriptorSets(void)
+{
+    VkDescriptorPoolSize poolSizes[4]     = { 0 };
+    poolSizes[0].type                     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount          = options.framesInFlight;
+    poolSizes[1].type                     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount          = options.framesInFlight * (ARR_LEN(cullBindings) - 2);
+    poolSizes[2].type                     = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount          = options.framesInFlight + depthPyramidLevels;
+    poolSizes[3].type                     = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[3].descriptorCount          = depthPyramidLevels;
+
+    {
+        VkDescriptorPoolCreateInfo createInfo = { 0 };
+        createInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        createInfo.poolSizeCount              = ARR_LEN(poolSizes);
+        createInfo.pPoolSizes                 = poolSizes;
+        createInfo.maxSets                    = options.framesInFlight + depthPyramidLevels;
+
+        VK_TRY(vkCreateDescriptorPool(device, &createInfo, NULL, &cullDescriptorPool), FATAL("could not create cull descriptor pool: %s\n", string_VkResult(result)));
+    }
+
+    for (uint32_t i = 0; i < options.framesInFlight; i++)
+    {
+        CullFrame *frame = &cullFrames[i];
+
+        VkDescriptorSetAllocateInfo allocInfo = { 0 };
+        allocInfo.sType                       = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool              = cullDescriptorPool;
+        allocInfo.descriptorSetCount          = 1;
+        allocInfo.pSetLayouts                 = &cullDescriptorSetLayout;
+
+        VK_TRY(vkAllocateDescriptorSets(device, &allocInfo, &frame->descriptorSet), FATAL("could not allocate cull descriptor set: %s\n", string_VkResult(result)));
+
+        VkDescriptorBufferInfo bufferInfos[ARR_LEN(cullBindings) - 1] = {
+            { uniformBuffers[i],  0, sizeof(UniformBufferObject) },
+            { instanceBuffer,     0, VK_WHOLE_SIZE },
+            { indirectBuffers[i], 0, VK_WHOLE_SIZE },
+            { drawBoundsBuffer,   0, VK_WHOLE_SIZE },
+            { frame->draws,       0, VK_WHOLE_SIZE },
+            { frame->instances,   0, VK_WHOLE_SIZE },
+            { frame->stats,       0, VK_WHOLE_SIZE },
+            { frame->occluded,    0, VK_WHOLE_SIZE }
+        };
+
+        VkDescriptorImageInfo imageInfo = { depthPyramidSampler, depthPyramidView, VK_IMAGE_LAYOUT_GENERAL };
+
+        VkWriteDescriptorSet writeDescriptors[ARR_LEN(cullBindings)] = { 0 };
+        for (uint32_t j = 0; j < ARR_LEN(cullBindings); j++)
+        {
+            writeDescriptors[j].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptors[j].dstSet           = frame->descriptorSet;
+            writeDescriptors[j].dstBinding       = j;
+            writeDescriptors[j].dstArrayElement  = 0;
+            writeDescriptors[j].descriptorType   = cullBindings[j];
+            writeDescriptors[j].descriptorCount  = 1;
+            if (j < ARR_LEN(bufferInfos)) writeDescriptors[j].pBufferInfo = &bufferInfos[j];
+            else writeDescriptors[j].pImageInfo = &imageInfo;
+        }
+
+        vkUpdateDescriptorSets(device, ARR_LEN(writeDescriptors), writeDescriptors, 0, NULL);
+    }
+
+    arrsetlen(depthPyramidDescriptorSets, depthPyramidLevels);
+    for (uint32_t i = 0; i < depthPyramidLevels; i++)
+    {
+        VkDescriptorSetAllocateInfo allocInfo = { 0 };
+        allocInfo.sType                       = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool              = cullDescriptorPool;
+        allocInfo.descriptorSetCount          = 1;
+        allocInfo.pSetLayouts                 = &depthPyramidDescriptorSetLayout;
+
+        VK_TRY(vkAllocateDescriptorSets(device, &allocInfo, &depthPyramidDescriptorSets[i]), FATAL("could not allocate depth pyramid descriptor set: %s\n", string_VkResult(result)));
+
+        // level 0 reads the depth buffer, which the early render pass leaves in SHADER_READ_ONLY_OPTIMAL
+        VkDescriptorImageInfo sourceInfo      = { depthPyramidSampler, i == 0 ? depthImageView : depthPyramidLevelViews[i - 1], i == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL };
+        VkDescriptorImageInfo destinationInfo = { VK_NULL_HANDLE, depthPyramidLevelViews[i], VK_IMAGE_LAYOUT_GENERAL };
+        VkDescriptorImageInfo *imageInfos[]   = { &sourceInfo, &destinationInfo };
+
+        VkWriteDescriptorSet writeDescriptors[ARR_LEN(depthPyramidBindings)] = { 0 };
+        for (uint32_t j = 0; j < ARR_LEN(depthPyramidBindings); j++)
+        {
+            writeDescriptors[j].sType            = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptors[j].dstSet           = depthPyramidDescriptorSets[i];
+            writeDescriptors[j].dstBinding       = j;
+            writeDescriptors[j].dstArrayElement  = 0;
+            writeDescriptors[j].descriptorType   = depthPyramidBindings[j];
+            writeDescriptors[j].descriptorCount  = 1;
+            writeDescriptors[j].pImageInfo       = imageInfos[j];
+        }
+
+        vkUpdateDescriptorSets(device, ARR_LEN(writeDescriptors), writeDescriptors, 0, NULL);
+    }
+}
+
+// after the uniform buffers, the draw list and the depth targets, the frame's descriptor set reads all of them
+static inline void createCulling(void)
+{
+    if (!cullingEnabled) return;
+
+    createComputePipeline("./shaders/cull.spv", cullBindings, ARR_LEN(cullBindings), sizeof(CullConstants), &cullDescriptorSetLayout, &cullPipelineLayout, &cullPipeline);
+    createComputePipeline("./shaders/hiz.spv", depthPyramidBindings, ARR_LEN(depthPyramidBindings), sizeof(PyramidConstants),
+                          &depthPyramidDescriptorSetLayout, &depthPyramidPipelineLayout, &depthPyramidPipeline);
+
+    // only ever read with texelFetch, the sampler is there because depth can't be bound as a storage image
+    VkSamplerCreateInfo samplerInfo     = { 0 };
+    samplerInfo.sType                   = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter               = VK_FILTER_NEAREST;
+    samplerInfo.minFilter               = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode              = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU            = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV            = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW            = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.borderColor             = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    samplerInfo.compareOp               = VK_COMPARE_OP_ALWAYS;
+    samplerInfo.maxLod                  = VK_LOD_CLAMP_NONE;
+
+    VK_TRY(vkCreateSampler(device, &samplerInfo, NULL, &depthPyramidSampler), FATAL("could not create depth pyramid sampler: %s\n", string_VkResult(result)));
+
+    // each draw owns a range of the culled instances big enough for its whole group, once per phase
+    VkDeviceSize drawsSize     = CULL_PHASE_COUNT * arrlen(drawList) * sizeof(VkDrawIndexedIndirectCommand);
+    VkDeviceSize instancesSize = CULL_PHASE_COUNT * arrlen(drawList) * instanceGroupCapacity * sizeof(Instance);
+    VkDeviceSize occludedSize  = arrlen(drawList) * instanceGroupCapacity * sizeof(uint32_t);
+
+    arrsetlen(cullFrames, options.framesInFlight);
+    for (uint32_t i = 0; i < options.framesInFlight; i++)
+    {
+        CullFrame *frame = &cullFrames[i];
+
+        createBuffer(drawsSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame->draws, &frame->drawsAllocation);
+        createBuffer(instancesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame->instances, &frame->instancesAllocation);
+        createBuffer(occludedSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &frame->occluded, &frame->occludedAllocation);
+        createBuffer(sizeof(CullStats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &frame->stats, &frame->statsAllocation);
+        memset(frame->statsAllocation.mapped, 0, sizeof(CullStats));
+    }
+
+    createCullDescriptorSets();
+
+    INFO("frustum and occlusion culling %u instances x %d submeshes in compute passes\n", (uint32_t) arrlen(instances), (int) arrlen(mesh.submeshes));
+}
+
+static inline void destroyCulling(void)
+{
+    if (!cullingEnabled) return;
+
+    for (uint32_t i = 0; i < options.framesInFlight; i++)
+    {
+        destroyBuffer(cullFrames[i].draws, &cullFrames[i].drawsAllocation);
+        destroyBuffer(cullFrames[i].instances, &cullFrames[i].instancesAllocation);
+        destroyBuffer(cullFrames[i].occluded, &cullFrames[i].occludedAllocation);
+        destroyBuffer(cullFrames[i].stats, &cullFrames[i].statsAllocation);
+    }
+    arrfree(cullFrames);
+    arrfree(depthPyramidDescriptorSets);
+
+    vkDestroyDescriptorPool(device, cullDescriptorPool, NULL);
+    vkDestroySampler(device, depthPyramidSampler, NULL);
+    vkDestroyPipeline(device, cullPipeline, NULL);
+    vkDestroyPipelineLayout(device, cullPipelineLayout, NULL);
+    vkDestroyDescriptorSetLayout(device, cullDescriptorSetLayout, NULL);
+    vkDestroyPipeline(device, depthPyramidPipeline, NULL);
+    vkDestroyPipelineLayout(device, depthPyramidPipelineLayout, NULL);
+    vkDestroyDescriptorSetLayout(device, depthPyramidDescriptorSetLayout, NULL);
+}
+
+
+static inline void createUniformBuffers(void)
+{
+    VkDeviceSize size = sizeof(UniformBufferObject);
+
+    arrsetlen(uniformBuffers, options.framesInFlight);
+    arrsetlen(uniformBufferAllocations, options.framesInFlight);
+
+    // TODO: merge to a single buffer with offsets
+    for (size_t i = 0; i < options.framesInFlight; i++)
+    {
+        createBuffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers[i], &uniformBufferAllocations[i]);
+    }
+}
+
+
+static inline void createDescriptorPool(void)
+{
+    VkDescriptorPoolSize poolSizes[2]     = { 0 };
+    poolSizes[0].type                     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount          = options.framesInFlight * instanceGroups;
+    poolSizes[1].type                     = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount          = options.framesInFlight * instanceGroups;
+
+    VkDescriptorPoolCreateInfo createInfo = { 0 };
+    createInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    createInfo.poolSizeCount              = ARR_LEN(poolSizes);
+    createInfo.pPoolSizes                 = poolSizes;
+    createInfo.maxSets                    = options.framesInFlight * instanceGroups;
+
+    VK_TRY(vkCreateDescriptorPool(device, &createInfo, NULL, &descriptorPool), FATAL("could not create descriptor pool: %s\n", string_VkResult(result)));
+}
+
+
+// one set per frame in flight and instance group, the group's texture bound alongside the frame's uniform buffer
+static inline void allocateDescriptorSets(void)
+{
+    uint32_t setCount = options.framesInFlight * instanceGroups;
+
+    // TODO: maybe try and optimize this? really doesn't matter though
+    VkDescriptorSetLayout *layouts = NULL;
+    for (size_t i = 0; i < setCount; i++) arrput(layouts, descriptorSetLayout);
+
+    VkDescriptorSetAllocateInfo allocInfo = { 0 };
+    allocInfo.sType                       = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool              = descriptorPool;
+    allocInfo.descriptorSetCount          = setCount;
+    allocInfo.pSetLayouts                 = layouts;
+
+    arrsetlen(descriptorSets, setCount);
+
+    VK_TRY(vkAllocateDescriptorSets(device, &allocInfo, descriptorSets), FATAL("could not allocate descriptor sets: %s\n", string_VkResult(result)));
+    arrfree(layouts);
+
+    for (size_t i = 0; i < setCount; i++)
+    {
+        VkDescriptorBufferInfo bufferInfo    = { 0 };
+        bufferInfo.buffer                    = uniformBuffers[i / instanceGroups];
+        bufferInfo.offset                    = 0;
+        bufferInfo.range                     = sizeof(UniformBufferObject);
+
+        VkDescriptorImageInfo imageInfo      = { 0 };
+        imageInfo.sampler                    = textureSampler;
+        imageInfo.imageView                  = textures[i % instanceGroups].view;
+        imageInfo.imageLayout                = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet writeDescriptors[2] = { 0 };
+        writeDescriptors[0].sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptors[0].dstSet               = descriptorSets[i];
+        writeDescriptors[0].dstBinding           = 0;
+        writeDescriptors[0].dstArrayElement      = 0;
+        writeDescriptors[0].descriptorType       = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writeDescriptors[0].descriptorCount      = 1;
+        writeDescriptors[0].pBufferInfo          = &bufferInfo;
+        writeDescriptors[1].sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptors[1].dstSet               = descriptorSets[i];
+        writeDescriptors[1].dstBinding           = 1;
+        writeDescriptors[1].dstArrayElement      = 0;
+        writeDescriptors[1].descriptorType       = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writeDescriptors[1].descriptorCount      = 1;
+        writeDescriptors[1].pImageInfo           = &imageInfo;
+
+        vkUpdateDescriptorSets(device, ARR_LEN(writeDescriptors), writeDescriptors, 0, NULL);
+    }
+}
+
+
+static inline void createSyncObjects(void)
+{
+    VkSemaphoreCreateInfo semaphoreCreateInfo = { 0 };
+    semaphoreCreateInfo.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fenceCreateInfo         = { 0 };
+    fenceCreateInfo.sType                     = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags                     = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    arrsetlen(imageAvailableSemaphores, options.framesInFlight);
+    arrsetlen(renderFinishedSemaphores, options.framesInFlight);
+    arrsetlen(inFlightFences, options.framesInFlight);
+    arrsetlen(frameStartTimes, options.framesInFlight);
+    memset(frameStartTimes, 0, options.framesInFlight * sizeof(double));
+    arrsetlen(frameSerials, options.framesInFlight);
+    memset(frameSerials, 0, options.framesInFlight * sizeof(uint64_t));
+
+    for (uint32_t i = 0; i < options.framesInFlight; i++)
+    {
+        VK_TRY(vkCreateSemaphore(device, &semaphoreCreateInfo, NULL, &imageAvailableSemaphores[i]), FATAL("could not create semaphore: %s\n", string_VkResult(result)));
+        VK_TRY(vkCreateSemaphore(device, &semaphoreCreateInfo, NULL, &renderFinishedSemaphores[i]), FATAL("could not create semaphore: %s\n", string_VkResult(result)));
+        VK_TRY(vkCreateFence(device, &fenceCreateInfo, NULL, &inFlightFences[i]), FATAL("could not create fence: %s\n", string_VkResult(result)));
+    }
+}
+
+
+static inline void createTimestampQueries(void)
+{
+    timestampMask = getTimestampMask(graphicsFamilyIndex);
+    if (timestampMask == 0)
+    {
+        WARN("graphics queue does not support timestamps, GPU timings are disabled\n");
+        return;
+    }
+
+    timestampQueryPool = createTimestampQueryPool(options.framesInFlight * GPU_SCOPE_COUNT * 2);
+
+    arrsetlen(timestampsWritten, options.framesInFlight);
+    memset(timestampsWritten, 0, options.framesInFlight * sizeof(bool));
+}
+
+static inline uint32_t gpuScopeQuery(uint32_t frame, GpuScope scope)
+{
+    return (frame * GPU_SCOPE_COUNT + scope) * 2;
+}
+
+static inline void beginGpuScope(VkCommandBuffer commandBuffer, GpuScope scope)
+{
+    if (timestampQueryPool != VK_NULL_HANDLE) vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, gpuScopeQuery(currentFrame, scope));
+}
+
+static inline void endGpuScope(VkCommandBuffer commandBuffer, GpuScope scope)
+{
+    if (timestampQueryPool != VK_NULL_HANDLE) vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, gpuScopeQuery(currentFrame, scope) + 1);
+}
+
+// called right after the frame's fence wait, so the results of the slot's previous frame are ready and this never stalls
+static void collectFrameTimestamps(FrameTiming *timing)
+{
+    timing->gpuUpload = uploadGpuTime;
+    uploadGpuTime     = 0;
+
+    if (timestampQueryPool == VK_NULL_HANDLE || !timestampsWritten[currentFrame]) return;
+
+    readTimestampPair(timestampQueryPool, gpuScopeQuery(currentFrame, GPU_SCOPE_RENDER_PASS), timestampMask, &timing->gpuRenderPass);
+    readTimestampPair(timestampQueryPool, gpuScopeQuery(currentFrame, GPU_SCOPE_DRAW), timestampMask, &timing->gpuDraw);
+    if (!cullingEnabled) return;
+
+    readTimestampPair(timestampQueryPool, gpuScopeQuery(currentFrame, GPU_SCOPE_CULL), timestampMask, &timing->gpuCull);
+    readTimestampPair(timestampQueryPool, gpuScopeQuery(currentFrame, GPU_SCOPE_DEPTH_PYRAMID), timestampMask, &timing->gpuDepthPyramid);
+    readTimestampPair(timestampQueryPool, gpuScopeQuery(currentFrame, GPU_SCOPE_LATE_CULL), timestampMask, &timing->gpuLateCull);
+    readTimestampPair(timestampQueryPool, gpuScopeQuery(currentFrame, GPU_SCOPE_LATE_DRAW), timestampMask, &timing->gpuLateDraw);
+}
+
+
+static void destroyDeletion(const Deletion *deletion)
+{
+    switch (deletion->type)
+    {
+        case DELETION_SWAPCHAIN:   vkDestroySwapchainKHR(device, deletion->swapchain, NULL); break;
+        case DELETION_IMAGE_VIEW:  vkDestroyImageView(device, deletion->imageView, NULL); break;
+        case DELETION_FRAMEBUFFER: vkDestroyFramebuffer(device, deletion->framebuffer, NULL); break;
+        case DELETION_PIPELINE:    vkDestroyPipeline(device, deletion->pipeline, NULL); break;
+        case DELETION_PIPELINE_LAYOUT: vkDestroyPipelineLayout(device, deletion->pipelineLayout, NULL); break;
+        case DELETION_DESCRIPTOR_POOL: vkDestroyDescriptorPool(device, deletion->descriptorPool, NULL); break;
+        case DELETION_BUFFER:
+        {
+            Allocation allocation = deletion->buffer.allocation;
+            destroyBuffer(deletion->buffer.handle, &allocation);
+        } break;
+        case DELETION_IMAGE:
+        {
+            Allocation allocation = deletion->image.allocation;
+            destroyImage(deletion->image.handle, &allocation);
+        } break;
+    }
+}
+
+// queues a handle used by frames up to and including the one being built now
+static inline void deferDeletion(Deletion deletion)
+{
+    deletion.retireAfter = frameNumber + 1;
+    deletion.queue       = NULL;
+    arrput(deletionQueue, deletion);
+}
+
+// queues a handle only referenced by uploads, it is destroyed once the upload with `token` completes
+static inline void deferDeletionAfterUpload(UploadQueue *queue, uint64_t token, Deletion deletion)
+{
+    deletion.retireAfter = token;
+    deletion.queue       = queue;
+    arrput(deletionQueue, deletion);
+}
+
+static inline void deferDestroyBuffer(VkBuffer buffer, Allocation *allocation)
+{
+    deferDeletion((Deletion){ .type = DELETION_BUFFER, .buffer = { buffer, *allocation } });
+    *allocation = (Allocation){ 0 };
+}
+
+static inline void deferDestroyImage(VkImage image, Allocation *allocation)
+{
+    deferDeletion((Deletion){ .type = DELETION_IMAGE, .image = { image, *allocation } });
+    *allocation = (Allocation){ 0 };
+}
+
+static inline bool isDeletionReady(const Deletion *deletion)
+{
+    if (deletion->queue != NULL) return uploadIsComplete(deletion->queue, deletion->retireAfter);
+    return deletion->retireAfter <= completedFrames;
+}
+
+// destroys everything whose frames have completed, or everything when the device is known to be idle
+static void processDeletions(bool all)
+{
+    for (int i = 0; i < arrlen(deletionQueue); i++)
+    {
+        if (!all && !isDeletionReady(&deletionQueue[i])) continue;
+
+        destroyDeletion(&deletionQueue[i]);
+        arrdel(deletionQueue, i);
+        i--;
+    }
+}
+
+// called once a slot's fence has been waited on
+static inline void retireFrame(uint32_t frame)
+{
+    if (frameSerials[frame] > completedFrames) completedFrames = frameSerials[frame];
+}
+
+
+static void cleanupSwapchain(void)
+{
+    for (int i = 0; i < arrlen(swapchainFramebuffers); i++)
+    {
+        vkDestroyFramebuffer(device, swapchainFramebuffers[i], NULL);
+    }
+
+    for (int i = 0; i < arrlen(swapchainImageViews); i++)
+    {
+        vkDestroyImageView(device, swapchainImageViews[i], NULL);
+    }
+
+    destroyDepthTargets();
+
+    if (options.headless) destroyOffscreenTargets();
+    else vkDestroySwapchainKHR(device, swapchain, NULL);
+}
+
+
+// recorded before each phase's render pass, the draws it writes are read by that phase's draw commands
+static void recordCullPass(VkCommandBuffer commandBuffer, uint32_t frame, CullPhase phase)
+{
+    GpuScope scope = phase == CULL_PHASE_EARLY ? GPU_SCOPE_CULL : GPU_SCOPE_LATE_CULL;
+    beginGpuScope(commandBuffer, scope);
+
+    if (phase == CULL_PHASE_EARLY)
+    {
+        vkCmdFillBuffer(commandBuffer, cullFrames[frame].draws, 0, VK_WHOLE_SIZE, 0);
+
+        // the pyramid is shared by all frames, the one the previous frame built has to be written before it is read
+        VkMemoryBarrier barrier = { 0 };
+        barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        // a new pyramid is moved to the layout it stays in, it isn't read until the first build
+        VkImageMemoryBarrier pyramidBarrier            = { 0 };
+        pyramidBarrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        pyramidBarrier.srcAccessMask                   = 0;
+        pyramidBarrier.dstAccessMask                   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        pyramidBarrier.oldLayout                       = VK_IMAGE_LAYOUT_UNDEFINED;
+        pyramidBarrier.newLayout                       = VK_IMAGE_LAYOUT_GENERAL;
+        pyramidBarrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+        pyramidBarrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+        pyramidBarrier.image                           = depthPyramid;
+        pyramidBarrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        pyramidBarrier.subresourceRange.baseMipLevel   = 0;
+        pyramidBarrier.subresourceRange.levelCount     = depthPyramidLevels;
+        pyramidBarrier.subresourceRange.baseArrayLayer = 0;
+        pyramidBarrier.subresourceRange.layerCount     = 1;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                             1, &barrier, 0, NULL, depthPyramidValid ? 0 : 1, &pyramidBarrier);
+    }
+
+    CullConstants constants    = { 0 };
+    constants.instanceCapacity = instanceGroupCapacity;
+    constants.drawCount        = arrlen(drawList);
+    constants.phase            = phase;
+    // the late phase always has this frame's pyramid, the early one only once a frame has built it
+    constants.occlusion        = phase == CULL_PHASE_LATE || depthPyramidValid;
+    constants.pyramidSize[0]   = swapchainExtent.width;
+    constants.pyramidSize[1]   = swapchainExtent.height;
+    constants.pyramidLevels    = depthPyramidLevels;
+    constants.reverseZ         = options.reverseZ;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullFrames[frame].descriptorSet, 0, NULL);
+    vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(commandBuffer, (groupInstanceCount(drawInstanceCount, 0) + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, arrlen(drawList), 1);
+
+    {
+        // the late phase reads the occluded flags the early one wrote
+        VkMemoryBarrier barrier = { 0 };
+        barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask   = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+    }
+
+    endGpuScope(commandBuffer, scope);
+}
+
+// recorded between the early and the late render pass, reducing the depth the early draws left into the pyramid
+static void recordDepthPyramid(VkCommandBuffer commandBuffer)
+{
+    beginGpuScope(commandBuffer, GPU_SCOPE_DEPTH_PYRAMID);
+
+    // the early render pass' outgoing dependency orders its depth writes before these reads
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipeline);
+
+    for (uint32_t i = 0; i < depthPyramidLevels; i++)
+    {
+        PyramidConstants constants   = { 0 };
+        constants.sourceSize[0]      = mipExtent(swapchainExtent.width, i == 0 ? 0 : i - 1);
+        constants.sourceSize[1]      = mipExtent(swapchainExtent.height, i == 0 ? 0 : i - 1);
+        constants.destinationSize[0] = mipExtent(swapchainExtent.width, i);
+        constants.destinationSize[1] = mipExtent(swapchainExtent.height, i);
+        constants.reverseZ           = options.reverseZ;
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipelineLayout, 0, 1, &depthPyramidDescriptorSets[i], 0, NULL);
+        vkCmdPushConstants(commandBuffer, depthPyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, (constants.destinationSize[0] + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE,
+                      (constants.destinationSize[1] + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE, 1);
+
+        // each level reads the one before it, the last is read by the late cull and the next frame's early cull
+        VkMemoryBarrier barrier = { 0 };
+        barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+    }
+
+    depthPyramidValid = true;
+
+    endGpuScope(commandBuffer, GPU_SCOPE_DEPTH_PYRAMID);
+}
+
+// called right after the frame's fence wait, the counters are cleared for the slot's next frame
+static void collectCullStats(FrameTiming *timing)
+{
+    if (!cullingEnabled)
+    {
+        timing->visibleInstances = drawInstanceCount * arrlen(mesh.submeshes);
+        return;
+    }
+
+    CullStats *stats          = cullFrames[currentFrame].statsAllocation.mapped;
+    timing->visibleInstances  = stats->visible;
+    timing->occludedInstances = stats->occluded;
+    memset(stats, 0, sizeof(CullStats));
+}
 
-        if (result == VK_SUBOPTIMAL_KHR) WARN("drawing onto suboptimal image\n");
-        else FATAL("could not acquire image for drawing: %s\n", string_VkResult(result));
-    });
 
-    vkResetFences(device, 1, &inFlightFence);
+// must be called whenever the swapchain extent, pipeline, bound buffers or draw list change
+static inline void invalidateDrawCommands(void)
+{
+    for (uint32_t i = 0; i < options.framesInFlight; i++) drawCommandsValid[i] = false;
+}
 
-    vkResetCommandBuffer(commandBuffer, 0);
+// the caller guarantees the frame's previous submission is done, the fence wait in drawFrame does
+static void recordPhaseDrawCommands(uint32_t frame, CullPhase phase)
+{
+    VkCommandBuffer commandBuffer = drawCommandBuffers[frame * CULL_PHASE_COUNT + phase];
 
-    VkClearValue clearColor = (VkClearValue){{{ 0.0f, 0.0f, 0.0f, 1.0f }}};
+    vkResetCommandBuffer(commandBuffer, 0);
 
     {
+        // the framebuffer is left out so the same commands can be executed on any swapchain image
+        VkCommandBufferInheritanceInfo inheritanceInfo = { 0 };
+        inheritanceInfo.sType                          = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass                     = phase == CULL_PHASE_EARLY ? renderPass : lateRenderPass;
+        inheritanceInfo.subpass                        = 0;
+        inheritanceInfo.framebuffer                    = VK_NULL_HANDLE;
+
         VkCommandBufferBeginInfo beginInfo = { 0 };
         beginInfo.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags                    = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo         = &inheritanceInfo;
 
-        VK_TRY(vkBeginCommandBuffer(commandBuffer, &beginInfo), FATAL("could not begin command buffer: %s\n", string_VkResult(result)));
-    }
-
-    {
-        VkRenderPassBeginInfo beginInfo    = { 0 };
-        beginInfo.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        beginInfo.renderPass               = renderPass;
-        beginInfo.framebuffer              = swapchainFramebuffers[imageIndex];
-        beginInfo.renderArea.offset        = (VkOffset2D){ 0, 0 };
-        beginInfo.renderArea.extent        = swapchainExtent;
-        beginInfo.clearValueCount          = 1;
-        beginInfo.pClearValues             = &clearColor;
-
-        vkCmdBeginRenderPass(commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        VK_TRY(vkBeginCommandBuffer(commandBuffer, &beginInfo), FATAL("could not begin draw command buffer: %s\n", string_VkResult(result)));
     }
 
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 
-    VkDeviceSize offset = 0;
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+    MeshConstants constants = { 0 };
+    glm_vec4(mesh.positionScale, 0.0f, constants.positionScale);
+    glm_vec4(mesh.positionBias, 0.0f, constants.positionBias);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
 
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    VkBuffer     vertexBuffers[] = { mesh.vertexBuffer, cullingEnabled ? cullFrames[frame].instances : instanceBuffer };
+    VkDeviceSize offsets[]       = { 0, 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, ARR_LEN(vertexBuffers), vertexBuffers, offsets);
+
+    vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, mesh.indexType);
 
     VkViewport viewport = { 0 };
     viewport.x          = 0.0f;
@@ -1207,28 +3842,490 @@ static inline void drawFrame(void)
     scissor.extent      = swapchainExtent;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, NULL);
+    // the draw count is all that's baked in here, the draws themselves are read from the indirect buffer when the GPU gets to them
+    uint32_t drawCount    = arrlen(drawList);
+    uint32_t submeshCount = arrlen(mesh.submeshes);
+    uint32_t batchSize    = multiDrawIndirect ? physicalDeviceProperties.limits.maxDrawIndirectCount : 1;
+    VkBuffer draws        = cullingEnabled ? cullFrames[frame].draws : indirectBuffers[frame];
+    GpuScope scope        = phase == CULL_PHASE_EARLY ? GPU_SCOPE_DRAW : GPU_SCOPE_LATE_DRAW;
+
+    beginGpuScope(commandBuffer, scope);
+    for (uint32_t group = 0; group < instanceGroups; group++)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[frame * instanceGroups + group], 0, NULL);
+
+        if (!cullingEnabled)
+        {
+            VkDeviceSize instanceOffset = groupFirstInstance(group) * sizeof(Instance);
+            vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BINDING, 1, &instanceBuffer, &instanceOffset);
+        }
+
+        for (uint32_t first = 0; first < submeshCount; first += batchSize)
+        {
+            uint32_t     count  = submeshCount - first < batchSize ? submeshCount - first : batchSize;
+            VkDeviceSize offset = (phase * drawCount + group * submeshCount + first) * sizeof(VkDrawIndexedIndirectCommand);
+            vkCmdDrawIndexedIndirect(commandBuffer, draws, offset, count, sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+    endGpuScope(commandBuffer, scope);
+
+    VK_TRY(vkEndCommandBuffer(commandBuffer), FATAL("could not record draw command buffer: %s\n", string_VkResult(result)));
+}
+
+static void recordDrawCommands(uint32_t frame)
+{
+    recordPhaseDrawCommands(frame, CULL_PHASE_EARLY);
+    if (cullingEnabled) recordPhaseDrawCommands(frame, CULL_PHASE_LATE);
+
+    drawCommandsValid[frame] = true;
+}
+
+
+// rebuilds the pipeline from the shaders on disk while the old one finishes the frames already in flight
+static void reloadGraphicsPipeline(void)
+{
+    deferDeletion((Deletion){ .type = DELETION_PIPELINE, .pipeline = graphicsPipeline });
+    deferDeletion((Deletion){ .type = DELETION_PIPELINE_LAYOUT, .pipelineLayout = pipelineLayout });
+
+    createGraphicsPipeline();
+    invalidateDrawCommands();
+
+    INFO("reloaded graphics pipeline\n");
+}
+
+
+static void recreateSwapchain(void)
+{
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    while (width == 0 || height == 0)
+    {
+        glfwWaitEvents();
+        glfwGetFramebufferSize(window, &width, &height);
+    }
+
+    // frames in flight may still render to the old images, so everything tied to them is retired instead of destroyed
+    for (int i = 0; i < arrlen(swapchainFramebuffers); i++) deferDeletion((Deletion){ .type = DELETION_FRAMEBUFFER, .framebuffer = swapchainFramebuffers[i] });
+    for (int i = 0; i < arrlen(swapchainImageViews); i++) deferDeletion((Deletion){ .type = DELETION_IMAGE_VIEW, .imageView = swapchainImageViews[i] });
+
+    deferDeletion((Deletion){ .type = DELETION_IMAGE_VIEW, .imageView = depthImageView });
+    deferDestroyImage(depthImage, &depthImageAllocation);
+
+    if (cullingEnabled)
+    {
+        for (uint32_t i = 0; i < depthPyramidLevels; i++) deferDeletion((Deletion){ .type = DELETION_IMAGE_VIEW, .imageView = depthPyramidLevelViews[i] });
+        deferDeletion((Deletion){ .type = DELETION_IMAGE_VIEW, .imageView = depthPyramidView });
+        deferDestroyImage(depthPyramid, &depthPyramidAllocation);
+        deferDeletion((Deletion){ .type = DELETION_DESCRIPTOR_POOL, .descriptorPool = cullDescriptorPool });
+    }
+
+    VkSwapchainKHR oldSwapchain = swapchain;
+
+    createSwapchain();
+    deferDeletion((Deletion){ .type = DELETION_SWAPCHAIN, .swapchain = oldSwapchain });
+
+    createImageViews();
+    createDepthTargets();
+    if (cullingEnabled) createCullDescriptorSets();
+    createFramebuffers();
+    invalidateDrawCommands();
+
+    INFO("recreated swapchain\n");
+}
+
+
+static const struct {
+    const char *name;
+    size_t      offset;
+} frameMetrics[] = {
+    { "frame",      offsetof(FrameTiming, frame)     },
+    { "fence_wait", offsetof(FrameTiming, fenceWait) },
+    { "pacing",     offsetof(FrameTiming, pacing)    },
+    { "acquire",    offsetof(FrameTiming, acquire)   },
+    { "record",     offsetof(FrameTiming, record)    },
+    { "submit",     offsetof(FrameTiming, submit)    },
+    { "present",    offsetof(FrameTiming, present)   },
+    // frame start until its fence is seen signalled, an upper bound on how stale the GPU's output is
+    { "latency",    offsetof(FrameTiming, latency)   },
+    // GPU scopes lag options.framesInFlight frames behind the CPU timings they are reported with
+    { "gpu_render_pass",   offsetof(FrameTiming, gpuRenderPass)   },
+    { "gpu_draw",          offsetof(FrameTiming, gpuDraw)         },
+    { "gpu_upload",        offsetof(FrameTiming, gpuUpload)       },
+    { "gpu_cull",          offsetof(FrameTiming, gpuCull)         },
+    { "gpu_depth_pyramid", offsetof(FrameTiming, gpuDepthPyramid) },
+    { "gpu_late_cull",     offsetof(FrameTiming, gpuLateCull)     },
+    { "gpu_late_draw",     offsetof(FrameTiming, gpuLateDraw)     },
+};
+
+typedef struct {
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+} MetricSummary;
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentiles over the measured frames, in milliseconds
+static MetricSummary summarizeMetric(size_t offset)
+{
+    size_t  count  = arrlen(frameTimings);
+    double *values = malloc(count * sizeof(double));
+    double  sum    = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        values[i] = 1000.0 * *(const double *)((const char *)&frameTimings[i] + offset);
+        sum      += values[i];
+    }
+
+    qsort(values, count, sizeof(double), compareDoubles);
+
+    #define PERCENTILE(p) values[(size_t) ceil((p) / 100.0 * count) - 1]
+    MetricSummary summary = {
+        .mean = sum / count,
+        .p50  = PERCENTILE(50),
+        .p95  = PERCENTILE(95),
+        .p99  = PERCENTILE(99),
+        .max  = values[count - 1],
+    };
+    #undef PERCENTILE
+
+    free(values);
+    return summary;
+}
+
+static void recordFrameTiming(const FrameTiming *timing)
+{
+    if (options.benchmarkPath == NULL || frameNumber <= options.warmup) return;
+
+    if (arrlen(frameTimings) == 0) benchmarkStart = getTime() - timing->frame;
+    arrput(frameTimings, *timing);
+}
+
+static void writeBenchmarkReport(void)
+{
+    size_t count = arrlen(frameTimings);
+    if (count == 0)
+    {
+        WARN("no frames were measured, skipping benchmark report\n");
+        return;
+    }
+
+    double duration = getTime() - benchmarkStart;
+
+    FILE *file = fopen(options.benchmarkPath, "w");
+    if (file == NULL)
+    {
+        ERROR("could not open %s for writing\n", options.benchmarkPath);
+        return;
+    }
+
+    const char *extension = strrchr(options.benchmarkPath, '.');
+    bool        csv       = extension != NULL && strcmp(extension, ".csv") == 0;
+
+    INFO("benchmark: %llu frames in %.3f s (%.1f FPS) after %u warm-up frames, %u frames in flight, %u swapchain images, present mode %s\n",
+         (unsigned long long) count, duration, count / duration, options.warmup, options.framesInFlight, (uint32_t)arrlen(swapchainImages), options.headless ? "none" : presentModeName(swapPresentMode));
+
+    double visibleInstances  = 0;
+    double occludedInstances = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        visibleInstances  += frameTimings[i].visibleInstances;
+        occludedInstances += frameTimings[i].occludedInstances;
+    }
+    visibleInstances  /= count;
+    occludedInstances /= count;
+
+    LOG("    - %.1f of %u instances x %d submeshes visible and %.1f occluded on average, culling %s\n",
+        visibleInstances, drawInstanceCount, (int) arrlen(mesh.submeshes), occludedInstances, cullingEnabled ? "enabled" : "disabled");
+
+    if (csv) fprintf(file, "metric,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+    else
+    {
+        fprintf(file, "{\n");
+        fprintf(file, "    \"device\": \"%s\",\n", physicalDeviceProperties.deviceName);
+        fprintf(file, "    \"headless\": %s,\n", options.headless ? "true" : "false");
+        fprintf(file, "    \"width\": %u,\n", swapchainExtent.width);
+        fprintf(file, "    \"height\": %u,\n", swapchainExtent.height);
+        fprintf(file, "    \"frames_in_flight\": %u,\n", options.framesInFlight);
+        fprintf(file, "    \"swapchain_images\": %u,\n", (uint32_t)arrlen(swapchainImages));
+        fprintf(file, "    \"present_mode\": \"%s\",\n", options.headless ? "none" : presentModeName(swapPresentMode));
+        fprintf(file, "    \"fps_cap\": %.3f,\n", options.fpsCap);
+        fprintf(file, "    \"wait_before_record\": %s,\n", options.waitBeforeRecord ? "true" : "false");
+        fprintf(file, "    \"instances\": %u,\n", drawInstanceCount);
+        fprintf(file, "    \"indirect_draws\": %u,\n", (uint32_t)arrlen(drawList));
+        fprintf(file, "    \"multi_draw_indirect\": %s,\n", multiDrawIndirect ? "true" : "false");
+        fprintf(file, "    \"culling\": %s,\n", cullingEnabled ? "true" : "false");
+        fprintf(file, "    \"reverse_z\": %s,\n", options.reverseZ ? "true" : "false");
+        fprintf(file, "    \"visible_instances_mean\": %.3f,\n", visibleInstances);
+        fprintf(file, "    \"occluded_instances_mean\": %.3f,\n", occludedInstances);
+        fprintf(file, "    \"warmup_frames\": %u,\n", options.warmup);
+        fprintf(file, "    \"frames\": %llu,\n", (unsigned long long) count);
+        fprintf(file, "    \"duration_s\": %.6f,\n", duration);
+        fprintf(file, "    \"fps\": %.3f,\n", count / duration);
+        fprintf(file, "    \"metrics_ms\": {\n");
+    }
+
+    for (size_t i = 0; i < ARR_LEN(frameMetrics); i++)
+    {
+        MetricSummary summary = summarizeMetric(frameMetrics[i].offset);
+
+        LOG("    - %-15s mean %8.3f ms  p50 %8.3f ms  p95 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n",
+            frameMetrics[i].name, summary.mean, summary.p50, summary.p95, summary.p99, summary.max);
+
+        if (csv) fprintf(file, "%s,%.6f,%.6f,%.6f,%.6f,%.6f\n", frameMetrics[i].name, summary.mean, summary.p50, summary.p95, summary.p99, summary.max);
+        else fprintf(file, "        \"%s\": { \"mean\": %.6f, \"p50\": %.6f, \"p95\": %.6f, \"p99\": %.6f, \"max\": %.6f }%s\n",
+                     frameMetrics[i].name, summary.mean, summary.p50, summary.p95, summary.p99, summary.max, i + 1 < ARR_LEN(frameMetrics) ? "," : "");
+    }
+
+    if (!csv) fprintf(file, "    }\n}\n");
+
+    fclose(file);
+    INFO("wrote benchmark report to %s\n", options.benchmarkPath);
+}
+
+// sleeps most of the way to the next paced frame and spins the rest, sleep granularity is too coarse on its own
+static void paceFrame(void)
+{
+    if (options.fpsCap <= 0) return;
+
+    double period = 1.0 / options.fpsCap;
+    double now    = getTime();
+
+    // after a long stall pace from now instead of rushing to catch up
+    if (nextFrameTime == 0 || now - nextFrameTime > period) nextFrameTime = now;
+
+    double remaining = nextFrameTime - now;
+    if (remaining > PACING_SPIN_TIME)
+    {
+        double sleepTime      = remaining - PACING_SPIN_TIME;
+        struct timespec sleep = { .tv_sec = (time_t)sleepTime, .tv_nsec = (long)(fmod(sleepTime, 1.0) * 1.0e9) };
+        nanosleep(&sleep, NULL);
+    }
+
+    while (getTime() < nextFrameTime);
+
+    nextFrameTime += period;
+}
+
+static void finishFrame(FrameTiming *timing)
+{
+    currentFrame = (currentFrame + 1) % options.framesInFlight;
+    frameNumber++;
+
+    double now    = getTime();
+    timing->frame = now - lastFrameEnd;
+    lastFrameEnd  = now;
+
+    // fixed step so headless output is reproducible frame for frame
+    deltaTime = options.headless ? FIXED_TIMESTEP : timing->frame;
+
+    recordFrameTiming(timing);
+}
+
+
+static inline void updateUniformBuffer(uint32_t currentFrame)
+{
+    static double angle = 0;
+    angle += deltaTime;
+
+    UniformBufferObject ubo;
+
+    glm_mat4_identity(ubo.model);
+    glm_rotate(ubo.model, angle * glm_rad(90.0f), (vec3){ 0.0f, 0.0f, 1.0f });
+
+    glm_lookat(cameraEye, (vec3){ 0.0f, 0.0f, 0.0f }, (vec3){ 0.0f, 1.0f, 0.0f }, ubo.view);
+
+    // with depth zero to one, swapping the planes maps far to 0 and near to 1, float depth then keeps its precision where distances are large
+    float aspect = (float) swapchainExtent.width / (float) swapchainExtent.height;
+    if (options.reverseZ) glm_perspective(glm_rad(45.0f), aspect, CAMERA_FAR, CAMERA_NEAR, ubo.proj);
+    else glm_perspective(glm_rad(45.0f), aspect, CAMERA_NEAR, CAMERA_FAR, ubo.proj);
+
+    memcpy(uniformBufferAllocations[currentFrame].mapped, &ubo, sizeof(ubo));
+}
+
+static inline void drawFrame(void)
+{
+    VkCommandBuffer commandBuffer           = commandBuffers[currentFrame];
+    VkFence         inFlightFence           = inFlightFences[currentFrame];
+    VkSemaphore     imageAvailableSemaphore = imageAvailableSemaphores[currentFrame];
+    VkSemaphore     renderFinishedSemaphore = renderFinishedSemaphores[currentFrame];
+
+    FrameTiming timing = { 0 };
+    double      mark   = getTime();
+
+    vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
+
+    // trades throughput for latency: the GPU is drained before input for this frame is sampled
+    if (options.waitBeforeRecord)
+    {
+        uint32_t previousFrame = (currentFrame + options.framesInFlight - 1) % options.framesInFlight;
+        vkWaitForFences(device, 1, &inFlightFences[previousFrame], VK_TRUE, UINT64_MAX);
+        retireFrame(previousFrame);
+    }
+
+    retireFrame(currentFrame);
+    processDeletions(false);
+
+    timing.fenceWait = getTime() - mark;
+    mark            += timing.fenceWait;
+
+    if (frameStartTimes[currentFrame] != 0) timing.latency = mark - frameStartTimes[currentFrame];
+
+    paceFrame();
+
+    timing.pacing = getTime() - mark;
+    mark         += timing.pacing;
+
+    // events are polled only once waiting is over so the frame is built from the freshest input
+    if (!options.headless) glfwPollEvents();
+
+    if (pipelineReloadRequested)
+    {
+        pipelineReloadRequested = false;
+        reloadGraphicsPipeline();
+    }
+
+    if (requestedInstanceCount != 0)
+    {
+        setDrawInstanceCount(requestedInstanceCount);
+        requestedInstanceCount = 0;
+        INFO("drawing %u instances\n", drawInstanceCount);
+    }
+
+    frameStartTimes[currentFrame] = mark;
+
+    collectFrameTimestamps(&timing);
+    collectCullStats(&timing);
+
+    // headless targets are owned per frame in flight, so the fence above already guards them
+    uint32_t imageIndex = currentFrame;
+    if (!options.headless) VK_TRY(vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex), {
+        if (result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            recreateSwapchain();
+            return;
+        }
+
+        if (result == VK_SUBOPTIMAL_KHR) WARN("drawing onto suboptimal image\n");
+        else FATAL("could not acquire image for drawing: %s\n", string_VkResult(result));
+    });
+
+    timing.acquire = getTime() - mark;
+    mark          += timing.acquire;
+
+    vkResetFences(device, 1, &inFlightFence);
+
+    vkResetCommandBuffer(commandBuffer, 0);
+
+    VkClearValue clearValues[2] = { 0 };
+    clearValues[0].color        = (VkClearColorValue){{ 0.0f, 0.0f, 0.0f, 1.0f }};
+    clearValues[1].depthStencil = (VkClearDepthStencilValue){ options.reverseZ ? 0.0f : 1.0f, 0 };
 
-    vkCmdDrawIndexed(commandBuffer, ARR_LEN(indices), 1, 0, 0, 0);
-    vkCmdEndRenderPass(commandBuffer);
+    {
+        VkCommandBufferBeginInfo beginInfo = { 0 };
+        beginInfo.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        VK_TRY(vkBeginCommandBuffer(commandBuffer, &beginInfo), FATAL("could not begin command buffer: %s\n", string_VkResult(result)));
+    }
+
+    if (timestampQueryPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(commandBuffer, timestampQueryPool, gpuScopeQuery(currentFrame, 0), GPU_SCOPE_COUNT * 2);
+        timestampsWritten[currentFrame] = true;
+    }
+
+    if (cullingEnabled) recordCullPass(commandBuffer, currentFrame, CULL_PHASE_EARLY);
+
+    // with culling this also spans the pyramid and the late cull between the two render passes
+    beginGpuScope(commandBuffer, GPU_SCOPE_RENDER_PASS);
+
+    if (!drawCommandsValid[currentFrame] || options.recordEveryFrame) recordDrawCommands(currentFrame);
+
+    for (uint32_t phase = 0; phase < (cullingEnabled ? CULL_PHASE_COUNT : 1); phase++)
+    {
+        if (phase == CULL_PHASE_LATE)
+        {
+            recordDepthPyramid(commandBuffer);
+            recordCullPass(commandBuffer, currentFrame, CULL_PHASE_LATE);
+        }
+
+        VkRenderPassBeginInfo beginInfo    = { 0 };
+        beginInfo.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        beginInfo.renderPass               = phase == CULL_PHASE_EARLY ? renderPass : lateRenderPass;
+        beginInfo.framebuffer              = swapchainFramebuffers[imageIndex];
+        beginInfo.renderArea.offset        = (VkOffset2D){ 0, 0 };
+        beginInfo.renderArea.extent        = swapchainExtent;
+        beginInfo.clearValueCount          = ARR_LEN(clearValues);
+        beginInfo.pClearValues             = clearValues;
+
+        vkCmdBeginRenderPass(commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(commandBuffer, 1, &drawCommandBuffers[currentFrame * CULL_PHASE_COUNT + phase]);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    endGpuScope(commandBuffer, GPU_SCOPE_RENDER_PASS);
+
+    // only the last frame is read back so it doesn't skew throughput
+    if (readbackBuffer != VK_NULL_HANDLE && frameNumber + 1 == options.frames) recordReadback(commandBuffer, swapchainImages[imageIndex]);
 
     VK_TRY(vkEndCommandBuffer(commandBuffer), FATAL("could not record command buffer: %s\n", string_VkResult(result)));
 
     updateUniformBuffer(currentFrame);
+    updateDrawList(currentFrame);
 
-    VkPipelineStageFlags stageFlags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    timing.record = getTime() - mark;
+    mark         += timing.record;
+
+    // uploads submitted since the last frame are waited on by the GPU right before their data is read
+    VkSemaphore          *waitSemaphores = NULL;
+    VkPipelineStageFlags *waitStages     = NULL;
+    if (!options.headless)
+    {
+        arrput(waitSemaphores, imageAvailableSemaphore);
+        arrput(waitStages, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    }
+    UploadQueue *uploadQueues[] = { &transferUploads, &graphicsUploads };
+    for (size_t i = 0; i < ARR_LEN(uploadQueues); i++)
+    {
+        for (int j = 0; j < arrlen(uploadQueues[i]->pendingSemaphores); j++)
+        {
+            arrput(waitSemaphores, uploadQueues[i]->pendingSemaphores[j]);
+            arrput(waitStages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        }
+        arrsetlen(uploadQueues[i]->pendingSemaphores, 0);
+    }
 
     VkSubmitInfo submitInfo         = { 0 };
     submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount   = 1;
-    submitInfo.pWaitSemaphores      = &imageAvailableSemaphore;
-    submitInfo.pWaitDstStageMask    = &stageFlags;
+    submitInfo.waitSemaphoreCount   = arrlen(waitSemaphores);
+    submitInfo.pWaitSemaphores      = waitSemaphores;
+    submitInfo.pWaitDstStageMask    = waitStages;
     submitInfo.commandBufferCount   = 1;
     submitInfo.pCommandBuffers      = &commandBuffer;
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = options.headless ? 0 : 1;
     submitInfo.pSignalSemaphores    = &renderFinishedSemaphore;
 
     VK_TRY(vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFence), FATAL("could not submit draw command buffer: %s\n", string_VkResult(result)));
+    frameSerials[currentFrame] = frameNumber + 1;
+
+    arrfree(waitSemaphores);
+    arrfree(waitStages);
+
+    timing.submit = getTime() - mark;
+    mark         += timing.submit;
+
+    if (options.headless)
+    {
+        finishFrame(&timing);
+        return;
+    }
 
     VkPresentInfoKHR presentInfo    = { 0 };
     presentInfo.sType               = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1240,6 +4337,8 @@ static inline void drawFrame(void)
 
     VkResult result = vkQueuePresentKHR(presentQueue, &presentInfo);
 
+    timing.present = getTime() - mark;
+
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
     {
         framebufferResized = false;
@@ -1247,28 +4346,25 @@ static inline void drawFrame(void)
     }
     else if (result != VK_SUCCESS) FATAL("could not present swapchain image: %s\n", string_VkResult(result));
 
-    currentFrame = (currentFrame + 1) % FRAMES_IN_FLIGHT;
-
-    // TODO: error handling
-    struct timespec currentClock;
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &currentClock);
-    deltaTime = (currentClock.tv_sec - lastFrameEnd.tv_sec) + 1.0e-9 * (currentClock.tv_nsec - lastFrameEnd.tv_nsec);
-    lastFrameEnd = currentClock;
+    finishFrame(&timing);
 }
 
 
 static inline void cleanup(void)
 {
-    for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+    for (uint32_t i = 0; i < options.framesInFlight; i++)
     {
         vkDestroySemaphore(device, imageAvailableSemaphores[i], NULL);
         vkDestroySemaphore(device, renderFinishedSemaphores[i], NULL);
         vkDestroyFence(device, inFlightFences[i], NULL);
 
-        vkDestroyBuffer(device, uniformBuffers[i], NULL);
-        vkFreeMemory(device, uniformBufferMemories[i], NULL);
+        destroyBuffer(uniformBuffers[i], &uniformBufferAllocations[i]);
     }
 
+    // the device is idle by now
+    processDeletions(true);
+    arrfree(deletionQueue);
+
     cleanupSwapchain();
 
     arrfree(swapchainImages);
@@ -1276,56 +4372,131 @@ static inline void cleanup(void)
     arrfree(swapPresentModes);
     arrfree(swapFormats);
 
+    arrfree(imageAvailableSemaphores);
+    arrfree(renderFinishedSemaphores);
+    arrfree(inFlightFences);
+    arrfree(frameStartTimes);
+    arrfree(frameSerials);
+    arrfree(uniformBuffers);
+    arrfree(uniformBufferAllocations);
+    arrfree(descriptorSets);
+    arrfree(commandBuffers);
+    arrfree(drawCommandBuffers);
+    arrfree(drawCommandsValid);
+    arrfree(timestampsWritten);
+
+    destroyStagingRing();
+    destroyUploadQueue(&transferUploads);
+    destroyUploadQueue(&graphicsUploads);
+    if (timestampQueryPool != VK_NULL_HANDLE) vkDestroyQueryPool(device, timestampQueryPool, NULL);
     vkDestroyCommandPool(device, commandPool, NULL);
-    vkDestroyBuffer(device, vertexBuffer, NULL);
-    vkFreeMemory(device, vertexBufferMemory, NULL);
-    vkDestroyBuffer(device, indexBuffer, NULL);
-    vkFreeMemory(device, indexBufferMemory, NULL);
+    destroyMesh();
+    destroyBuffer(instanceBuffer, &instanceBufferAllocation);
+    arrfree(instances);
+    destroyCulling();
+    destroyDrawList();
+    for (int i = 0; i < arrlen(textures); i++)
+    {
+        vkDestroyImageView(device, textures[i].view, NULL);
+        destroyImage(textures[i].image, &textures[i].allocation);
+    }
+    vkDestroySampler(device, textureSampler, NULL);
+    arrfree(textures);
+    arrfree(options.texturePaths);
     vkDestroyPipeline(device, graphicsPipeline, NULL);
+    savePipelineCache();
+    vkDestroyPipelineCache(device, pipelineCache, NULL);
     vkDestroyPipelineLayout(device, pipelineLayout, NULL);
     vkDestroyDescriptorPool(device, descriptorPool, NULL);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, NULL);
     vkDestroyRenderPass(device, renderPass, NULL);
+    if (lateRenderPass != VK_NULL_HANDLE) vkDestroyRenderPass(device, lateRenderPass, NULL);
+
+    printMemoryStats();
+    destroyMemoryArena();
+
     vkDestroyDevice(device, NULL);
-    vkDestroySurfaceKHR(instance, surface, NULL);
+    if (!options.headless) vkDestroySurfaceKHR(instance, surface, NULL);
     vkDestroyInstance(instance, NULL);
 
+    if (options.headless) return;
+
     glfwDestroyWindow(window);
     glfwTerminate();
 }
 
 
-int main(void)
+static inline bool shouldRun(void)
 {
-    createWindow();
+    if (options.frames != 0 && frameNumber >= options.frames) return false;
+
+    // a benchmark's duration starts once warm-up is over and frames are being recorded
+    if (options.duration > 0 && options.benchmarkPath == NULL && getTime() - runStart >= options.duration) return false;
+    if (options.duration > 0 && arrlen(frameTimings) > 0 && getTime() - benchmarkStart >= options.duration) return false;
+
+    return options.headless || !glfwWindowShouldClose(window);
+}
+
+
+int main(int argc, char **argv)
+{
+    parseOptions(argc, argv);
+
+    if (!options.headless) createWindow();
     createVulkanInstance();
-    createWindowSurface();
+    if (!options.headless) createWindowSurface();
     findSuitableGPU();
     createLogicalDevice();
-    createSwapchain();
+    createMemoryArena();
+    if (options.headless) createOffscreenTargets();
+    else createSwapchain();
     createImageViews();
+    createDepthTargets();
     createRenderPass();
     createDescriptorSetLayout();
-    createGraphicsPipeline();
+    createPipelineCache();
     createFramebuffers();
     createCommandPool();
     allocateCommandBuffers();
-    createTextureImage();
-    createVertexBuffer();
-    createIndexBuffer();
+    createUploadQueue(&transferUploads, transferFamilyIndex);
+    createUploadQueue(&graphicsUploads, graphicsFamilyIndex);
+    createStagingRing();
+    createTextureImages();
+    createTextureSampler();
+    createMesh();
+    createInstances();
+    createDrawList();
+    uploadSubmit(&transferUploads);
+    uploadSubmit(&graphicsUploads);
+    // after the mesh since the vertex input state comes from its layout, the uploads run meanwhile
+    createGraphicsPipeline();
     createUniformBuffers();
     createDescriptorPool();
     allocateDescriptorSets();
+    createCulling();
     createSyncObjects();
+    createTimestampQueries();
 
-    while (!glfwWindowShouldClose(window))
-    {
-        glfwPollEvents();
+    printMemoryStats();
+
+    double start = getTime();
+    runStart     = start;
+    lastFrameEnd = start;
 
+    while (shouldRun())
+    {
         drawFrame();
     }
 
     vkDeviceWaitIdle(device);
+
+    double elapsed = getTime() - start;
+    INFO("rendered %llu frames in %.3f s (%.1f FPS)\n", (unsigned long long) frameNumber, elapsed, elapsed > 0 ? frameNumber / elapsed : 0.0);
+
+    if (readbackBuffer != VK_NULL_HANDLE) writeReadback();
+    if (options.benchmarkPath != NULL) writeBenchmarkReport();
+    arrfree(frameTimings);
+
     cleanup();
 
     return 0;
@@ -1,9 +1,18 @@
 #version 450
 
+layout(binding = 1) uniform sampler2D texSampler;
+
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 fragNormal;
 
 layout(location = 0) out vec4 outColor;
 
+// a fixed world space light towards +z, the side the camera looks from, so surfaces facing +z keep the texture's full brightness
+const vec3  lightDirection = vec3(0.0, 0.0, 1.0);
+const float ambient        = 0.2;
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+    float diffuse = max(dot(normalize(fragNormal), lightDirection), 0.0);
+    outColor = texture(texSampler, fragTexCoord) * vec4(vec3(ambient + (1.0 - ambient) * diffuse), 1.0);
+}
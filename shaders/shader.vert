@@ -6,13 +6,37 @@ layout(binding  = 0) uniform UniformBufferObject {
     mat4 proj;
 } ubo;
 
+// quantized positions are stored normalized, this maps them back to model space
+layout(push_constant) uniform MeshConstants {
+    vec4 positionScale;
+    vec4 positionBias;
+} mesh;
+
 layout(location = 0) in      vec3 inPosition;
 layout(location = 1) in      vec3 inColor;
+layout(location = 2) in      vec2 inTexCoord;
+layout(location = 3) in      vec2 inNormal;
+// per instance, one location per column
+layout(location = 4) in      mat4 inInstanceModel;
 
 layout(location = 0) out     vec3 fragColor;
+layout(location = 1) out     vec2 fragTexCoord;
+layout(location = 2) out     vec3 fragNormal;
+
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (normal.z < 0.0) normal.xy = (1.0 - abs(normal.yx)) * vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(normal);
+}
 
 void main()
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    vec3 position = inPosition * mesh.positionScale.xyz + mesh.positionBias.xyz;
+    mat4 model    = ubo.model * inInstanceModel;
+
+    gl_Position = ubo.proj * ubo.view * model * vec4(position, 1.0);
     fragColor = inColor;
-}
\ No newline at end of file
+    fragTexCoord = inTexCoord;
+    fragNormal = mat3(model) * decodeOctahedral(inNormal);
+}
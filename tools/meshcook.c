@@ -0,0 +1,889 @@
+// meshcook: converts a Wavefront OBJ into a .cmesh the renderer can copy straight into its vertex and index buffers
+//
+// usage: meshcook [options] <input.obj> <output.cmesh>, see --help
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+
+#include "formats.h"
+
+
+#define FATAL(...) do \
+{ \
+    fprintf(stderr, "\e[1;31mFATAL:\e[0m " __VA_ARGS__); \
+    exit(-1); \
+} while (0)
+
+#define WARN(...) \
+    fprintf(stderr, "\e[1;33mWARN:\e[0m " __VA_ARGS__)
+
+#define INFO(...) \
+    printf("\e[0;36mINFO:\e[0m " __VA_ARGS__)
+
+#define ARR_LEN(array) (sizeof((array))/sizeof((array)[0]))
+
+#define ALIGN_UP(value, alignment) (((value) + (alignment) - 1) / (alignment) * (alignment))
+
+
+// every attribute at full precision, what gets quantized into the chosen layout
+typedef struct {
+    float pos[3];
+    float color[3];
+    float texCoord[2];
+    float normal[3];
+} Vertex;
+
+// an OBJ face corner, position, texture coordinate and normal indices (-1 when absent)
+typedef struct {
+    int32_t position;
+    int32_t texCoord;
+    int32_t normal;
+} Corner;
+
+typedef struct {
+    Corner   key;
+    uint32_t value;
+} CornerEntry;
+
+typedef struct {
+    float position[3];
+    float color[3];
+} Position;
+
+typedef struct {
+    const char *name;
+    VkFormat    format;
+} LayoutChoice;
+
+// the first entry is the default, texture coordinates default to unorm16 only when they all lie in [0, 1]
+static const LayoutChoice positionChoices[] = { { "snorm16", VK_FORMAT_R16G16B16A16_SNORM }, { "half", VK_FORMAT_R16G16B16A16_SFLOAT }, { "float", VK_FORMAT_R32G32B32_SFLOAT } };
+static const LayoutChoice colorChoices[]    = { { "unorm8", VK_FORMAT_R8G8B8A8_UNORM }, { "float", VK_FORMAT_R32G32B32_SFLOAT } };
+static const LayoutChoice texCoordChoices[] = { { "unorm16", VK_FORMAT_R16G16_UNORM }, { "half", VK_FORMAT_R16G16_SFLOAT }, { "float", VK_FORMAT_R32G32_SFLOAT } };
+static const LayoutChoice normalChoices[]   = { { "snorm16", VK_FORMAT_R16G16_SNORM }, { "snorm8", VK_FORMAT_R8G8_SNORM }, { "float", VK_FORMAT_R32G32_SFLOAT } };
+
+// what the renderer's built-in float layout takes per vertex, the baseline quantization is measured against
+#define FLOAT_VERTEX_SIZE (12 + 12 + 8 + 8)
+
+// post-transform vertex cache entries assumed by the optimizer and the statistics
+#define VERTEX_CACHE_SIZE 16
+
+// vertices a 16-bit index can address from a draw's vertexOffset
+#define SHORT_INDEX_VERTICES (UINT16_MAX + 1)
+
+typedef enum {
+    INDEX_CHOICE_AUTO,
+    INDEX_CHOICE_SHORT,
+    INDEX_CHOICE_LONG
+} IndexChoice;
+
+// a run of triangles Tipsify emitted without jumping elsewhere in the mesh, the unit reordered for overdraw
+typedef struct {
+    uint32_t firstTriangle;
+    uint32_t triangleCount;
+    float    occlusion;
+} Cluster;
+
+
+static VkFormat parseLayoutChoice(const LayoutChoice *choices, size_t count, const char *attribute, const char *name)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(choices[i].name, name) == 0) return choices[i].format;
+    }
+
+    FATAL("unknown %s format: %s\n", attribute, name);
+}
+
+// round to nearest even, out of range values become infinity and denormals flush to zero
+static uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign     = bits >> 16 & 0x8000;
+    int32_t  exponent = (int32_t)(bits >> 23 & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if ((bits & 0x7fffffff) > 0x7f800000) return sign | 0x7e00;
+    if (exponent >= 31) return sign | 0x7c00;
+    if (exponent <= 0) return sign;
+
+    uint32_t half = sign | exponent << 10 | mantissa >> 13;
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+
+    return half;
+}
+
+static float clampUnit(float value, float min)
+{
+    return value < min ? min : value > 1.0f ? 1.0f : value;
+}
+
+// writes count components in the given format, padding formats with more components with zeroes
+static void encodeAttribute(const float *values, uint32_t count, VkFormat format, uint8_t *out)
+{
+    switch (format)
+    {
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            memcpy(out, values, count * sizeof(float));
+            break;
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            for (uint32_t i = 0; i < count; i++) ((uint16_t *)out)[i] = floatToHalf(values[i]);
+            break;
+        case VK_FORMAT_R16G16_SNORM:
+        case VK_FORMAT_R16G16B16A16_SNORM:
+            for (uint32_t i = 0; i < count; i++) ((int16_t *)out)[i] = (int16_t) lroundf(clampUnit(values[i], -1.0f) * 32767.0f);
+            break;
+        case VK_FORMAT_R16G16_UNORM:
+            for (uint32_t i = 0; i < count; i++) ((uint16_t *)out)[i] = (uint16_t) lroundf(clampUnit(values[i], 0.0f) * 65535.0f);
+            break;
+        case VK_FORMAT_R8G8_SNORM:
+            for (uint32_t i = 0; i < count; i++) ((int8_t *)out)[i] = (int8_t) lroundf(clampUnit(values[i], -1.0f) * 127.0f);
+            break;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+            for (uint32_t i = 0; i < count; i++) out[i] = (uint8_t) lroundf(clampUnit(values[i], 0.0f) * 255.0f);
+            // vertex colors are opaque
+            out[3] = 255;
+            break;
+        default:
+            FATAL("no encoder for vertex format %d\n", format);
+    }
+}
+
+// projects the unit normal onto the octahedron |x| + |y| + |z| = 1 and folds the lower half over the upper one
+static void encodeOctahedral(const float normal[3], float encoded[2])
+{
+    float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if (length == 0.0f)
+    {
+        encoded[0] = encoded[1] = 0.0f;
+        return;
+    }
+
+    float x = normal[0] / length;
+    float y = normal[1] / length;
+
+    if (normal[2] < 0.0f)
+    {
+        float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x             = foldedX;
+        y             = foldedY;
+    }
+
+    encoded[0] = x;
+    encoded[1] = y;
+}
+
+// resolves a 1-based or negative (relative to the end) OBJ index, -1 if it is out of range
+static int32_t resolveIndex(long index, int32_t count)
+{
+    if (index > 0 && index <= count) return index - 1;
+    if (index < 0 && -index <= count) return count + index;
+    return -1;
+}
+
+// v, v/vt, v//vn and v/vt/vn
+static bool parseCorner(const char *token, int32_t positionCount, int32_t texCoordCount, int32_t normalCount, Corner *corner)
+{
+    char *end;
+    long  position = strtol(token, &end, 10);
+
+    corner->position = resolveIndex(position, positionCount);
+    corner->texCoord = -1;
+    corner->normal   = -1;
+    if (corner->position < 0) return false;
+    if (*end != '/') return true;
+
+    if (end[1] != '/')
+    {
+        corner->texCoord = resolveIndex(strtol(end + 1, &end, 10), texCoordCount);
+        if (corner->texCoord < 0) return false;
+        if (*end != '/') return true;
+    }
+    else end++;
+
+    corner->normal = resolveIndex(strtol(end + 1, NULL, 10), normalCount);
+    return corner->normal >= 0;
+}
+
+// FIFO cache simulation, ACMR is misses per triangle (0.5 at best for big regular meshes, 3 at worst),
+// ATVR misses per referenced vertex (1 means each vertex is transformed once)
+static void measureVertexCache(const uint32_t *indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize, double *acmr, double *atvr)
+{
+    uint32_t *cache      = calloc(cacheSize, sizeof(uint32_t));
+    bool     *referenced = calloc(vertexCount, sizeof(bool));
+    uint32_t  cached     = 0;
+    uint32_t  head       = 0;
+    uint32_t  misses     = 0;
+    uint32_t  used       = 0;
+
+    for (uint32_t i = 0; i < indexCount; i++)
+    {
+        uint32_t vertex = indices[i];
+
+        bool hit = false;
+        for (uint32_t j = 0; j < cached && !hit; j++) hit = cache[j] == vertex;
+        if (hit) continue;
+
+        misses++;
+        cache[head] = vertex;
+        head        = (head + 1) % cacheSize;
+        if (cached < cacheSize) cached++;
+
+        if (!referenced[vertex]) used++;
+        referenced[vertex] = true;
+    }
+
+    *acmr = (double) misses / (indexCount / 3);
+    *atvr = (double) misses / used;
+
+    free(referenced);
+    free(cache);
+}
+
+// Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"):
+// fans around a vertex at a time, picking the next one among the vertices just emitted that will still be in the cache
+// once its remaining triangles are emitted, and records where it had to jump as cluster boundaries
+static void tipsify(const uint32_t *indices, uint32_t triangleCount, uint32_t vertexCount, uint32_t cacheSize, uint32_t *output, Cluster **clusters)
+{
+    // triangles of each vertex, as offsets into one array
+    uint32_t *adjacencyOffsets = calloc(vertexCount + 1, sizeof(uint32_t));
+    uint32_t *adjacency        = malloc(triangleCount * 3 * sizeof(uint32_t));
+    for (uint32_t i = 0; i < triangleCount * 3; i++) adjacencyOffsets[indices[i] + 1]++;
+    for (uint32_t i = 0; i < vertexCount; i++) adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+
+    uint32_t *liveTriangles = calloc(vertexCount, sizeof(uint32_t));
+    for (uint32_t i = 0; i < triangleCount * 3; i++) adjacency[adjacencyOffsets[indices[i]] + liveTriangles[indices[i]]++] = i / 3;
+
+    uint32_t *cacheTime    = calloc(vertexCount, sizeof(uint32_t));
+    bool     *emitted      = calloc(triangleCount, sizeof(bool));
+    uint32_t *deadEnd      = NULL;
+    uint32_t  time         = cacheSize + 1;
+    uint32_t  cursor       = 0;
+    uint32_t  outputCount  = 0;
+    int64_t   fanning      = triangleCount > 0 ? (int64_t) indices[0] : -1;
+
+    arrput(*clusters, ((Cluster){ 0 }));
+
+    while (fanning >= 0)
+    {
+        // the vertices emitted by this fan are the candidates for the next one
+        ptrdiff_t candidates = arrlen(deadEnd);
+
+        for (uint32_t i = adjacencyOffsets[fanning]; i < adjacencyOffsets[fanning + 1]; i++)
+        {
+            uint32_t triangle = adjacency[i];
+            if (emitted[triangle]) continue;
+
+            for (uint32_t j = 0; j < 3; j++)
+            {
+                uint32_t vertex = indices[triangle * 3 + j];
+
+                output[outputCount++] = vertex;
+                arrput(deadEnd, vertex);
+                liveTriangles[vertex]--;
+
+                if (time - cacheTime[vertex] > cacheSize) cacheTime[vertex] = time++;
+            }
+
+            emitted[triangle] = true;
+        }
+
+        // the candidate furthest along in the cache that fanning around won't push out of it
+        int64_t  next         = -1;
+        uint32_t bestPriority = 0;
+        for (ptrdiff_t i = candidates; i < arrlen(deadEnd); i++)
+        {
+            uint32_t vertex = deadEnd[i];
+            if (liveTriangles[vertex] == 0) continue;
+
+            uint32_t priority = time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize ? time - cacheTime[vertex] : 0;
+            if (next < 0 || priority > bestPriority)
+            {
+                next         = vertex;
+                bestPriority = priority;
+            }
+        }
+
+        if (next < 0)
+        {
+            // jumping somewhere else starts a new cluster
+            while (arrlen(deadEnd) > 0 && next < 0)
+            {
+                uint32_t vertex = arrpop(deadEnd);
+                if (liveTriangles[vertex] > 0) next = vertex;
+            }
+            while (next < 0 && cursor < vertexCount)
+            {
+                if (liveTriangles[cursor] > 0) next = cursor;
+                cursor++;
+            }
+
+            if (next >= 0 && outputCount / 3 > arrlast(*clusters).firstTriangle)
+            {
+                arrlast(*clusters).triangleCount = outputCount / 3 - arrlast(*clusters).firstTriangle;
+                arrput(*clusters, ((Cluster){ .firstTriangle = outputCount / 3 }));
+            }
+        }
+
+        fanning = next;
+    }
+
+    arrlast(*clusters).triangleCount = outputCount / 3 - arrlast(*clusters).firstTriangle;
+
+    arrfree(deadEnd);
+    free(emitted);
+    free(cacheTime);
+    free(liveTriangles);
+    free(adjacency);
+    free(adjacencyOffsets);
+}
+
+static int compareClusters(const void *a, const void *b)
+{
+    float occlusionA = ((const Cluster *)a)->occlusion;
+    float occlusionB = ((const Cluster *)b)->occlusion;
+    return (occlusionA < occlusionB) - (occlusionA > occlusionB);
+}
+
+// draws the clusters most likely to occlude the rest first: those far out from the centroid, facing away from it
+static void sortClustersForOverdraw(uint32_t *indices, uint32_t triangleCount, const Vertex *vertices, Cluster *clusters)
+{
+    float meshCentroid[3] = { 0 };
+    for (uint32_t i = 0; i < triangleCount * 3; i++)
+    {
+        for (int c = 0; c < 3; c++) meshCentroid[c] += vertices[indices[i]].pos[c] / (triangleCount * 3);
+    }
+
+    for (int i = 0; i < arrlen(clusters); i++)
+    {
+        float centroid[3] = { 0 }, normal[3] = { 0 };
+        for (uint32_t t = clusters[i].firstTriangle; t < clusters[i].firstTriangle + clusters[i].triangleCount; t++)
+        {
+            const float *a = vertices[indices[t * 3]].pos, *b = vertices[indices[t * 3 + 1]].pos, *c = vertices[indices[t * 3 + 2]].pos;
+
+            float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            normal[0] += ab[1] * ac[2] - ab[2] * ac[1];
+            normal[1] += ab[2] * ac[0] - ab[0] * ac[2];
+            normal[2] += ab[0] * ac[1] - ab[1] * ac[0];
+
+            for (int k = 0; k < 3; k++) centroid[k] += (a[k] + b[k] + c[k]) / (3.0f * clusters[i].triangleCount);
+        }
+
+        float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        clusters[i].occlusion = 0.0f;
+        for (int k = 0; k < 3 && length > 0.0f; k++) clusters[i].occlusion += (centroid[k] - meshCentroid[k]) * normal[k] / length;
+    }
+
+    uint32_t *sorted = malloc(triangleCount * 3 * sizeof(uint32_t));
+    qsort(clusters, arrlen(clusters), sizeof(Cluster), compareClusters);
+
+    uint32_t written = 0;
+    for (int i = 0; i < arrlen(clusters); i++)
+    {
+        memcpy(&sorted[written], &indices[clusters[i].firstTriangle * 3], clusters[i].triangleCount * 3 * sizeof(uint32_t));
+        written += clusters[i].triangleCount * 3;
+    }
+
+    memcpy(indices, sorted, triangleCount * 3 * sizeof(uint32_t));
+    free(sorted);
+}
+
+// reorders each submesh's triangles for the vertex cache and overdraw, then the vertices into first use order for fetch locality
+static void optimizeMesh(uint32_t *indices, uint32_t indexCount, Vertex *vertices, uint32_t vertexCount, const MeshSubmesh *submeshes, uint32_t cacheSize)
+{
+    uint32_t *reordered = malloc(indexCount * sizeof(uint32_t));
+    uint32_t  clusterCount = 0;
+
+    for (int i = 0; i < arrlen(submeshes); i++)
+    {
+        Cluster  *clusters = NULL;
+        uint32_t *range    = &reordered[submeshes[i].firstIndex];
+
+        tipsify(&indices[submeshes[i].firstIndex], submeshes[i].indexCount / 3, vertexCount, cacheSize, range, &clusters);
+        sortClustersForOverdraw(range, submeshes[i].indexCount / 3, vertices, clusters);
+
+        clusterCount += arrlen(clusters);
+        arrfree(clusters);
+    }
+
+    memcpy(indices, reordered, indexCount * sizeof(uint32_t));
+    free(reordered);
+
+    uint32_t *remap = malloc(vertexCount * sizeof(uint32_t));
+    memset(remap, 0xff, vertexCount * sizeof(uint32_t));
+
+    Vertex  *fetchOrder = malloc(vertexCount * sizeof(Vertex));
+    uint32_t nextVertex = 0;
+    for (uint32_t i = 0; i < indexCount; i++)
+    {
+        if (remap[indices[i]] == UINT32_MAX)
+        {
+            remap[indices[i]]        = nextVertex;
+            fetchOrder[nextVertex++] = vertices[indices[i]];
+        }
+
+        indices[i] = remap[indices[i]];
+    }
+
+    // every vertex came from a face corner, so each one is referenced
+    memcpy(vertices, fetchOrder, nextVertex * sizeof(Vertex));
+
+    INFO("reordered %u triangles in %u clusters\n", indexCount / 3, clusterCount);
+
+    free(fetchOrder);
+    free(remap);
+}
+
+// cuts every submesh into chunks of consecutive triangles referencing at most SHORT_INDEX_VERTICES vertices,
+// each chunk getting its own copy of the vertices it uses in first use order and indices relative to its vertexOffset
+static void splitForShortIndices(uint32_t *indices, const Vertex *vertices, uint32_t vertexCount, const MeshSubmesh *submeshes,
+                                 Vertex **chunkVertices, MeshSubmesh **chunkSubmeshes)
+{
+    uint32_t *local        = malloc(vertexCount * sizeof(uint32_t));
+    uint32_t *touched      = malloc(SHORT_INDEX_VERTICES * sizeof(uint32_t));
+    uint32_t  touchedCount = 0;
+    memset(local, 0xff, vertexCount * sizeof(uint32_t));
+
+    for (int i = 0; i < arrlen(submeshes); i++)
+    {
+        uint32_t end = submeshes[i].firstIndex + submeshes[i].indexCount;
+
+        for (uint32_t triangle = submeshes[i].firstIndex; triangle < end; triangle += 3)
+        {
+            uint32_t added = 0;
+            for (uint32_t j = triangle; j < triangle + 3; j++) added += local[indices[j]] == UINT32_MAX;
+
+            if (triangle == submeshes[i].firstIndex || touchedCount + added > SHORT_INDEX_VERTICES)
+            {
+                for (uint32_t j = 0; j < touchedCount; j++) local[touched[j]] = UINT32_MAX;
+                touchedCount = 0;
+
+                if (arrlen(*chunkSubmeshes) > 0) arrlast(*chunkSubmeshes).indexCount = triangle - arrlast(*chunkSubmeshes).firstIndex;
+                arrput(*chunkSubmeshes, ((MeshSubmesh){ .firstIndex = triangle, .vertexOffset = arrlen(*chunkVertices) }));
+            }
+
+            for (uint32_t j = triangle; j < triangle + 3; j++)
+            {
+                if (local[indices[j]] == UINT32_MAX)
+                {
+                    local[indices[j]]       = touchedCount;
+                    touched[touchedCount++] = indices[j];
+                    arrput(*chunkVertices, vertices[indices[j]]);
+                }
+
+                indices[j] = local[indices[j]];
+            }
+        }
+
+        arrlast(*chunkSubmeshes).indexCount = end - arrlast(*chunkSubmeshes).firstIndex;
+    }
+
+    free(touched);
+    free(local);
+}
+
+static void finishSubmesh(MeshSubmesh **submeshes, uint32_t indexCount)
+{
+    MeshSubmesh *last = &arrlast(*submeshes);
+    last->indexCount  = indexCount - last->firstIndex;
+
+    // groups without faces aren't worth a draw
+    if (last->indexCount == 0) arrsetlen(*submeshes, arrlen(*submeshes) - 1);
+}
+
+static void usage(const char *program)
+{
+    printf("usage: %s [options] <input.obj> <output.cmesh>\n", program);
+    printf("    --position <f>  snorm16, half or float (default: snorm16, scaled to the mesh bounds)\n");
+    printf("    --color <f>     unorm8 or float (default: unorm8)\n");
+    printf("    --texcoord <f>  unorm16, half or float (default: unorm16 if all coordinates are in [0, 1], half otherwise)\n");
+    printf("    --normal <f>    snorm16, snorm8 or float, octahedral encoded (default: snorm16)\n");
+    printf("    --cache-size <n> vertex cache entries to optimize for (default: %d)\n", VERTEX_CACHE_SIZE);
+    printf("    --no-optimize   keep the triangle and vertex order of the OBJ\n");
+    printf("    --index-type <t> 16, 32 or auto: 16-bit unless splitting into 64k vertex chunks costs more than it saves (default: auto)\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *inputPath   = NULL;
+    const char *outputPath  = NULL;
+    uint32_t    cacheSize   = VERTEX_CACHE_SIZE;
+    bool        optimize    = true;
+    IndexChoice indexChoice = INDEX_CHOICE_AUTO;
+
+    VkFormat formats[VERTEX_ATTRIBUTE_COUNT] = {
+        [VERTEX_ATTRIBUTE_POSITION] = positionChoices[0].format,
+        [VERTEX_ATTRIBUTE_COLOR]    = colorChoices[0].format,
+        [VERTEX_ATTRIBUTE_TEXCOORD] = VK_FORMAT_UNDEFINED,
+        [VERTEX_ATTRIBUTE_NORMAL]   = normalChoices[0].format
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg   = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--position") == 0 && value != NULL)
+        {
+            formats[VERTEX_ATTRIBUTE_POSITION] = parseLayoutChoice(positionChoices, ARR_LEN(positionChoices), "position", value);
+            i++;
+        }
+        else if (strcmp(arg, "--color") == 0 && value != NULL)
+        {
+            formats[VERTEX_ATTRIBUTE_COLOR] = parseLayoutChoice(colorChoices, ARR_LEN(colorChoices), "color", value);
+            i++;
+        }
+        else if (strcmp(arg, "--texcoord") == 0 && value != NULL)
+        {
+            formats[VERTEX_ATTRIBUTE_TEXCOORD] = parseLayoutChoice(texCoordChoices, ARR_LEN(texCoordChoices), "texture coordinate", value);
+            i++;
+        }
+        else if (strcmp(arg, "--normal") == 0 && value != NULL)
+        {
+            formats[VERTEX_ATTRIBUTE_NORMAL] = parseLayoutChoice(normalChoices, ARR_LEN(normalChoices), "normal", value);
+            i++;
+        }
+        else if (strcmp(arg, "--cache-size") == 0 && value != NULL)
+        {
+            cacheSize = strtoul(value, NULL, 10);
+            if (cacheSize == 0) FATAL("invalid cache size: %s\n", value);
+            i++;
+        }
+        else if (strcmp(arg, "--no-optimize") == 0) optimize = false;
+        else if (strcmp(arg, "--index-type") == 0 && value != NULL)
+        {
+            if (strcmp(value, "16") == 0) indexChoice = INDEX_CHOICE_SHORT;
+            else if (strcmp(value, "32") == 0) indexChoice = INDEX_CHOICE_LONG;
+            else if (strcmp(value, "auto") == 0) indexChoice = INDEX_CHOICE_AUTO;
+            else FATAL("unknown index type: %s\n", value);
+            i++;
+        }
+        else if (strcmp(arg, "--help") == 0)
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        else if (inputPath == NULL) inputPath = arg;
+        else if (outputPath == NULL) outputPath = arg;
+        else
+        {
+            usage(argv[0]);
+            FATAL("unexpected argument: %s\n", arg);
+        }
+    }
+
+    if (inputPath == NULL || outputPath == NULL)
+    {
+        usage(argv[0]);
+        FATAL("missing input or output path\n");
+    }
+
+    FILE *input = fopen(inputPath, "r");
+    if (input == NULL) FATAL("could not open %s\n", inputPath);
+
+    Position    *positions = NULL;
+    float      (*texCoords)[2] = NULL;
+    float      (*normals)[3]   = NULL;
+    Vertex      *vertices  = NULL;
+    bool        *hasNormal = NULL;
+    uint32_t    *indices   = NULL;
+    MeshSubmesh *submeshes = NULL;
+    CornerEntry *corners   = NULL;
+
+    arrput(submeshes, (MeshSubmesh){ 0 });
+
+    char     line[4096];
+    uint32_t lineNumber = 0;
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        lineNumber++;
+
+        if (strncmp(line, "v ", 2) == 0)
+        {
+            // some exporters append a vertex color to the position
+            Position position = { .color = { 1.0f, 1.0f, 1.0f } };
+            int      count    = sscanf(line + 2, "%f %f %f %f %f %f", &position.position[0], &position.position[1], &position.position[2],
+                                       &position.color[0], &position.color[1], &position.color[2]);
+            if (count != 3 && count != 6) FATAL("%s:%u: malformed vertex\n", inputPath, lineNumber);
+
+            arrput(positions, position);
+        }
+        else if (strncmp(line, "vt ", 3) == 0)
+        {
+            float texCoord[2];
+            if (sscanf(line + 3, "%f %f", &texCoord[0], &texCoord[1]) != 2) FATAL("%s:%u: malformed texture coordinate\n", inputPath, lineNumber);
+
+            // OBJ puts v = 0 at the bottom of the image, Vulkan at the top
+            arrsetlen(texCoords, arrlen(texCoords) + 1);
+            arrlast(texCoords)[0] = texCoord[0];
+            arrlast(texCoords)[1] = 1.0f - texCoord[1];
+        }
+        else if (strncmp(line, "vn ", 3) == 0)
+        {
+            float normal[3];
+            if (sscanf(line + 3, "%f %f %f", &normal[0], &normal[1], &normal[2]) != 3) FATAL("%s:%u: malformed normal\n", inputPath, lineNumber);
+
+            arrsetlen(normals, arrlen(normals) + 1);
+            memcpy(arrlast(normals), normal, sizeof(normal));
+        }
+        else if (strncmp(line, "f ", 2) == 0)
+        {
+            uint32_t polygon[64];
+            uint32_t cornerCount = 0;
+
+            for (char *token = strtok(line + 2, " \t\r\n"); token != NULL; token = strtok(NULL, " \t\r\n"))
+            {
+                if (cornerCount == ARR_LEN(polygon)) FATAL("%s:%u: face has more than %d corners\n", inputPath, lineNumber, (int) ARR_LEN(polygon));
+
+                Corner corner = { 0 };
+                if (!parseCorner(token, arrlen(positions), arrlen(texCoords), arrlen(normals), &corner)) FATAL("%s:%u: invalid face index %s\n", inputPath, lineNumber, token);
+
+                // corners sharing all their attributes become one vertex
+                ptrdiff_t entry = hmgeti(corners, corner);
+                if (entry < 0)
+                {
+                    Vertex vertex = { 0 };
+                    memcpy(vertex.pos, positions[corner.position].position, sizeof(vertex.pos));
+                    memcpy(vertex.color, positions[corner.position].color, sizeof(vertex.color));
+                    if (corner.texCoord >= 0) memcpy(vertex.texCoord, texCoords[corner.texCoord], sizeof(vertex.texCoord));
+                    if (corner.normal >= 0) memcpy(vertex.normal, normals[corner.normal], sizeof(vertex.normal));
+
+                    hmput(corners, corner, arrlen(vertices));
+                    arrput(vertices, vertex);
+                    arrput(hasNormal, corner.normal >= 0);
+                    entry = hmgeti(corners, corner);
+                }
+
+                polygon[cornerCount++] = corners[entry].value;
+            }
+
+            if (cornerCount < 3) FATAL("%s:%u: face has fewer than 3 corners\n", inputPath, lineNumber);
+
+            // fan triangulation, fine for the convex polygons exporters write
+            for (uint32_t i = 1; i + 1 < cornerCount; i++)
+            {
+                arrput(indices, polygon[0]);
+                arrput(indices, polygon[i]);
+                arrput(indices, polygon[i + 1]);
+            }
+        }
+        else if (strncmp(line, "o ", 2) == 0 || strncmp(line, "g ", 2) == 0 || strncmp(line, "usemtl ", 7) == 0)
+        {
+            finishSubmesh(&submeshes, arrlen(indices));
+            arrput(submeshes, ((MeshSubmesh){ .firstIndex = arrlen(indices) }));
+        }
+    }
+
+    fclose(input);
+    finishSubmesh(&submeshes, arrlen(indices));
+
+    if (arrlen(indices) == 0) FATAL("%s has no faces\n", inputPath);
+    if (arrlen(texCoords) == 0) WARN("%s has no texture coordinates\n", inputPath);
+
+    uint32_t vertexCount = arrlen(vertices);
+    uint32_t indexCount  = arrlen(indices);
+
+    // vertices without a normal get the area weighted sum of their faces' normals
+    uint32_t generatedNormals = 0;
+    for (uint32_t i = 0; i < indexCount; i += 3)
+    {
+        const float *a = vertices[indices[i]].pos, *b = vertices[indices[i + 1]].pos, *c = vertices[indices[i + 2]].pos;
+
+        float ab[3]         = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float ac[3]         = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float faceNormal[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+
+        for (uint32_t j = i; j < i + 3; j++)
+        {
+            if (hasNormal[indices[j]]) continue;
+            for (int k = 0; k < 3; k++) vertices[indices[j]].normal[k] += faceNormal[k];
+        }
+    }
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        float *normal = vertices[i].normal;
+        float  length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length > 0.0f) for (int k = 0; k < 3; k++) normal[k] /= length;
+        if (!hasNormal[i]) generatedNormals++;
+    }
+    if (generatedNormals > 0) WARN("%s: generated normals for %u vertices\n", inputPath, generatedNormals);
+
+    if (optimize)
+    {
+        double acmrBefore, atvrBefore, acmrAfter, atvrAfter;
+        measureVertexCache(indices, indexCount, vertexCount, cacheSize, &acmrBefore, &atvrBefore);
+
+        optimizeMesh(indices, indexCount, vertices, vertexCount, submeshes, cacheSize);
+
+        measureVertexCache(indices, indexCount, vertexCount, cacheSize, &acmrAfter, &atvrAfter);
+        INFO("vertex cache (%u entries): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", cacheSize, acmrBefore, acmrAfter, atvrBefore, atvrAfter);
+    }
+
+    float boundsMin[3]  = { INFINITY, INFINITY, INFINITY };
+    float boundsMax[3]  = { -INFINITY, -INFINITY, -INFINITY };
+    bool  unitTexCoords = true;
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            boundsMin[c] = fminf(boundsMin[c], vertices[i].pos[c]);
+            boundsMax[c] = fmaxf(boundsMax[c], vertices[i].pos[c]);
+        }
+        for (int c = 0; c < 2; c++) unitTexCoords &= vertices[i].texCoord[c] >= 0.0f && vertices[i].texCoord[c] <= 1.0f;
+    }
+
+    if (formats[VERTEX_ATTRIBUTE_TEXCOORD] == VK_FORMAT_UNDEFINED) formats[VERTEX_ATTRIBUTE_TEXCOORD] = unitTexCoords ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R16G16_SFLOAT;
+    if (formats[VERTEX_ATTRIBUTE_TEXCOORD] == VK_FORMAT_R16G16_UNORM && !unitTexCoords) WARN("%s: texture coordinates outside [0, 1] are clamped by unorm16\n", inputPath);
+
+    MeshHeader header = { 0 };
+    header.magic      = MESH_MAGIC;
+    header.version    = MESH_VERSION;
+
+    // attributes stay 4 byte aligned, which every vertex fetch path handles
+    for (uint32_t i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++)
+    {
+        header.attributes[i] = (MeshAttribute){ formats[i], header.vertexStride };
+        header.vertexStride  = ALIGN_UP(header.vertexStride + vertexFormatSize(formats[i]), 4);
+    }
+
+    // meshes too big for 16-bit indices are split into chunks that each address at most 64k vertices from their vertexOffset,
+    // unless the vertices duplicated across chunks cost more than 32-bit indices would
+    VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+    if (vertexCount > SHORT_INDEX_VERTICES)
+    {
+        uint32_t    *chunkIndices   = malloc(indexCount * sizeof(uint32_t));
+        Vertex      *chunkVertices  = NULL;
+        MeshSubmesh *chunkSubmeshes = NULL;
+        memcpy(chunkIndices, indices, indexCount * sizeof(uint32_t));
+
+        splitForShortIndices(chunkIndices, vertices, vertexCount, submeshes, &chunkVertices, &chunkSubmeshes);
+
+        uint64_t duplicatedSize = (uint64_t)(arrlen(chunkVertices) - vertexCount) * header.vertexStride;
+        uint64_t savedSize      = (uint64_t)indexCount * (indexTypeSize(VK_INDEX_TYPE_UINT32) - indexTypeSize(VK_INDEX_TYPE_UINT16));
+
+        if (indexChoice == INDEX_CHOICE_SHORT || (indexChoice == INDEX_CHOICE_AUTO && duplicatedSize < savedSize))
+        {
+            INFO("split %u vertices into %d chunks for 16-bit indices, duplicating %u vertices (%llu KiB) to save %llu KiB of indices\n",
+                 vertexCount, (int) arrlen(chunkSubmeshes), (uint32_t) arrlen(chunkVertices) - vertexCount, (unsigned long long) duplicatedSize / 1024, (unsigned long long) savedSize / 1024);
+
+            memcpy(indices, chunkIndices, indexCount * sizeof(uint32_t));
+            arrfree(vertices);
+            arrfree(submeshes);
+            vertices    = chunkVertices;
+            submeshes   = chunkSubmeshes;
+            vertexCount = arrlen(vertices);
+        }
+        else
+        {
+            indexType = VK_INDEX_TYPE_UINT32;
+            arrfree(chunkVertices);
+            arrfree(chunkSubmeshes);
+        }
+
+        free(chunkIndices);
+    }
+    if (indexChoice == INDEX_CHOICE_LONG) indexType = VK_INDEX_TYPE_UINT32;
+
+    for (int i = 0; i < arrlen(submeshes); i++)
+    {
+        MeshSubmesh *submesh = &submeshes[i];
+        for (int c = 0; c < 3; c++)
+        {
+            submesh->boundsMin[c] = INFINITY;
+            submesh->boundsMax[c] = -INFINITY;
+        }
+
+        for (uint32_t j = submesh->firstIndex; j < submesh->firstIndex + submesh->indexCount; j++)
+        {
+            const Vertex *vertex = &vertices[submesh->vertexOffset + indices[j]];
+            for (int c = 0; c < 3; c++)
+            {
+                submesh->boundsMin[c] = fminf(submesh->boundsMin[c], vertex->pos[c]);
+                submesh->boundsMax[c] = fmaxf(submesh->boundsMax[c], vertex->pos[c]);
+            }
+        }
+    }
+
+    header.vertexCount  = vertexCount;
+    header.indexType    = indexType;
+    header.indexCount   = indexCount;
+    header.submeshCount = arrlen(submeshes);
+
+    // quantized positions are stored relative to the mesh bounds so they use the whole [-1, 1] range
+    bool normalized = formats[VERTEX_ATTRIBUTE_POSITION] != VK_FORMAT_R32G32B32_SFLOAT;
+    for (int c = 0; c < 3; c++)
+    {
+        float extent = 0.5f * (boundsMax[c] - boundsMin[c]);
+
+        header.positionScale[c] = normalized && extent > 0.0f ? extent : 1.0f;
+        header.positionBias[c]  = normalized ? 0.5f * (boundsMax[c] + boundsMin[c]) : 0.0f;
+    }
+
+    uint64_t vertexSize = (uint64_t)vertexCount * header.vertexStride;
+    uint64_t indexSize  = (uint64_t)indexCount * indexTypeSize(indexType);
+
+    header.vertexDataOffset = ALIGN_UP(sizeof(header) + header.submeshCount * sizeof(MeshSubmesh), MESH_ALIGNMENT);
+    header.indexDataOffset  = ALIGN_UP(header.vertexDataOffset + vertexSize, MESH_ALIGNMENT);
+    uint64_t fileSize       = header.indexDataOffset + indexSize;
+
+    uint8_t *file = calloc(fileSize, 1);
+    memcpy(file, &header, sizeof(header));
+    memcpy(file + sizeof(header), submeshes, header.submeshCount * sizeof(MeshSubmesh));
+
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        uint8_t *vertex = file + header.vertexDataOffset + (uint64_t)i * header.vertexStride;
+
+        float position[3];
+        for (int c = 0; c < 3; c++) position[c] = (vertices[i].pos[c] - header.positionBias[c]) / header.positionScale[c];
+
+        float normal[2];
+        encodeOctahedral(vertices[i].normal, normal);
+
+        encodeAttribute(position, 3, formats[VERTEX_ATTRIBUTE_POSITION], vertex + header.attributes[VERTEX_ATTRIBUTE_POSITION].offset);
+        encodeAttribute(vertices[i].color, 3, formats[VERTEX_ATTRIBUTE_COLOR], vertex + header.attributes[VERTEX_ATTRIBUTE_COLOR].offset);
+        encodeAttribute(vertices[i].texCoord, 2, formats[VERTEX_ATTRIBUTE_TEXCOORD], vertex + header.attributes[VERTEX_ATTRIBUTE_TEXCOORD].offset);
+        encodeAttribute(normal, 2, formats[VERTEX_ATTRIBUTE_NORMAL], vertex + header.attributes[VERTEX_ATTRIBUTE_NORMAL].offset);
+    }
+
+    if (indexType == VK_INDEX_TYPE_UINT16)
+    {
+        uint16_t *narrow = (uint16_t *)(file + header.indexDataOffset);
+        for (uint32_t i = 0; i < indexCount; i++) narrow[i] = (uint16_t) indices[i];
+    }
+    else memcpy(file + header.indexDataOffset, indices, indexSize);
+
+    FILE *output = fopen(outputPath, "wb");
+    if (output == NULL) FATAL("could not open %s for writing\n", outputPath);
+    if (fwrite(file, fileSize, 1, output) != 1 || fclose(output) != 0) FATAL("could not write %s\n", outputPath);
+
+    INFO("cooked %s to %s: %u vertices, %u triangles, %u submeshes, %s indices, %llu KiB\n",
+         inputPath, outputPath, vertexCount, indexCount / 3, header.submeshCount, indexType == VK_INDEX_TYPE_UINT16 ? "16-bit" : "32-bit",
+         (unsigned long long) fileSize / 1024);
+    INFO("%u B per vertex, %.2fx smaller than the %u B float layout\n", header.vertexStride, (double) FLOAT_VERTEX_SIZE / header.vertexStride, FLOAT_VERTEX_SIZE);
+
+    free(file);
+    hmfree(corners);
+    arrfree(submeshes);
+    arrfree(indices);
+    arrfree(hasNormal);
+    arrfree(vertices);
+    arrfree(normals);
+    arrfree(texCoords);
+    arrfree(positions);
+
+    return 0;
+}
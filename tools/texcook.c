@@ -0,0 +1,688 @@
+// texcook: converts a JPEG/PNG into a cooked .ctex texture with a block compressed mip chain
+//
+// usage: texcook [--format bc1|bc3|bc7|etc2|etc2a|rgba8] [--linear] <input> <output.ctex>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "formats.h"
+
+
+#define FATAL(...) do \
+{ \
+    fprintf(stderr, "\e[1;31mFATAL:\e[0m " __VA_ARGS__); \
+    exit(-1); \
+} while (0)
+
+#define INFO(...) \
+    printf("\e[0;36mINFO:\e[0m " __VA_ARGS__)
+
+#define ALIGN_UP(value, alignment) (((value) + (alignment) - 1) / (alignment) * (alignment))
+
+
+typedef enum {
+    TARGET_AUTO,
+    TARGET_BC1,
+    TARGET_BC3,
+    TARGET_BC7,
+    TARGET_ETC2,
+    TARGET_ETC2_ALPHA,
+    TARGET_RGBA8
+} Target;
+
+
+static inline uint16_t packRgb565(const int color[3])
+{
+    return (uint16_t)(((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255));
+}
+
+static inline void unpackRgb565(uint16_t packed, int color[3])
+{
+    int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+    color[0] = r << 3 | r >> 2;
+    color[1] = g << 2 | g >> 4;
+    color[2] = b << 3 | b >> 2;
+}
+
+// endpoints span the block's bounding box, its diagonal flipped to follow how green and blue correlate with red,
+// then pulled in by 1/16 of the range since the extremes are rarely worth an endpoint
+static void encodeColorBlock(const uint8_t texels[16][4], uint8_t out[8])
+{
+    int minColor[3] = { 255, 255, 255 }, maxColor[3] = { 0, 0, 0 };
+    float mean[3]   = { 0 };
+
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            if (texels[i][c] < minColor[c]) minColor[c] = texels[i][c];
+            if (texels[i][c] > maxColor[c]) maxColor[c] = texels[i][c];
+            mean[c] += texels[i][c] / 16.0f;
+        }
+    }
+
+    float covariance[3] = { 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        float red = texels[i][0] - mean[0];
+        for (int c = 1; c < 3; c++) covariance[c] += red * (texels[i][c] - mean[c]);
+    }
+
+    for (int c = 1; c < 3; c++)
+    {
+        if (covariance[c] >= 0) continue;
+
+        int swap    = minColor[c];
+        minColor[c] = maxColor[c];
+        maxColor[c] = swap;
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        int inset    = (maxColor[c] - minColor[c]) / 16;
+        maxColor[c] -= inset;
+        minColor[c] += inset;
+    }
+
+    uint16_t color0 = packRgb565(maxColor);
+    uint16_t color1 = packRgb565(minColor);
+
+    // four color mode needs color0 > color1, equal endpoints mean a flat block
+    if (color0 < color1)
+    {
+        uint16_t swap = color0;
+        color0        = color1;
+        color1        = swap;
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        int palette[4][3];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestDistance = INT32_MAX;
+            for (int p = 0; p < 4; p++)
+            {
+                int distance = 0;
+                for (int c = 0; c < 3; c++) distance += (texels[i][c] - palette[p][c]) * (texels[i][c] - palette[p][c]);
+
+                if (distance < bestDistance)
+                {
+                    best         = p;
+                    bestDistance = distance;
+                }
+            }
+
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    out[0] = color0 & 0xff;
+    out[1] = color0 >> 8;
+    out[2] = color1 & 0xff;
+    out[3] = color1 >> 8;
+    memcpy(&out[4], &indices, sizeof(indices));
+}
+
+// BC3 alpha: the block's alpha range split into 8 steps
+static void encodeAlphaBlock(const uint8_t texels[16][4], uint8_t out[8])
+{
+    int alpha0 = 0, alpha1 = 255;
+    for (int i = 0; i < 16; i++)
+    {
+        if (texels[i][3] > alpha0) alpha0 = texels[i][3];
+        if (texels[i][3] < alpha1) alpha1 = texels[i][3];
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1)
+    {
+        int palette[8] = { alpha0, alpha1 };
+        for (int p = 1; p < 7; p++) palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestDistance = INT32_MAX;
+            for (int p = 0; p < 8; p++)
+            {
+                int distance = abs(texels[i][3] - palette[p]);
+                if (distance < bestDistance)
+                {
+                    best         = p;
+                    bestDistance = distance;
+                }
+            }
+
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+
+    out[0] = alpha0;
+    out[1] = alpha1;
+    for (int i = 0; i < 6; i++) out[2 + i] = indices >> (8 * i) & 0xff;
+}
+
+// BC7 mode 6: a single RGBA line with 4-bit indices, endpoints taken from the block's bounding box like BC1
+// and each endpoint's shared p-bit picked to round the 8-bit values best
+static void encodeBc7Block(const uint8_t texels[16][4], uint8_t out[16])
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    int   endpoints[2][4] = { { 255, 255, 255, 255 }, { 0, 0, 0, 0 } };
+    float mean[4]         = { 0 };
+
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            if (texels[i][c] < endpoints[0][c]) endpoints[0][c] = texels[i][c];
+            if (texels[i][c] > endpoints[1][c]) endpoints[1][c] = texels[i][c];
+            mean[c] += texels[i][c] / 16.0f;
+        }
+    }
+
+    float covariance[4] = { 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        float red = texels[i][0] - mean[0];
+        for (int c = 1; c < 4; c++) covariance[c] += red * (texels[i][c] - mean[c]);
+    }
+
+    for (int c = 1; c < 4; c++)
+    {
+        if (covariance[c] >= 0) continue;
+
+        int swap        = endpoints[0][c];
+        endpoints[0][c] = endpoints[1][c];
+        endpoints[1][c] = swap;
+    }
+
+    int quantized[2][4], pBits[2];
+    for (int e = 0; e < 2; e++)
+    {
+        int bestError = INT32_MAX;
+        for (int p = 0; p < 2; p++)
+        {
+            int values[4], error = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                values[c] = (endpoints[e][c] - p + 1) / 2;
+                if (values[c] > 127) values[c] = 127;
+
+                int difference = endpoints[e][c] - (values[c] << 1 | p);
+                error += difference * difference;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                pBits[e]  = p;
+                memcpy(quantized[e], values, sizeof(values));
+            }
+        }
+
+        for (int c = 0; c < 4; c++) endpoints[e][c] = quantized[e][c] << 1 | pBits[e];
+    }
+
+    int indices[16];
+    for (int i = 0; i < 16; i++)
+    {
+        int bestDistance = INT32_MAX;
+        for (int w = 0; w < 16; w++)
+        {
+            int distance = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                int value = ((64 - weights[w]) * endpoints[0][c] + weights[w] * endpoints[1][c] + 32) >> 6;
+                distance += (texels[i][c] - value) * (texels[i][c] - value);
+            }
+
+            if (distance < bestDistance)
+            {
+                indices[i]   = w;
+                bestDistance = distance;
+            }
+        }
+    }
+
+    // the first texel's index drops its top bit, so swap the endpoints when it would be set
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            int swap        = quantized[0][c];
+            quantized[0][c] = quantized[1][c];
+            quantized[1][c] = swap;
+        }
+
+        int swap = pBits[0];
+        pBits[0] = pBits[1];
+        pBits[1] = swap;
+
+        for (int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+    }
+
+    uint64_t bits[2] = { 0 };
+    int      bit     = 0;
+
+#define PUT_BITS(value, count) do \
+{ \
+    uint64_t putValue = (uint64_t)(value); \
+    for (int putBit = 0; putBit < (count); putBit++, bit++) bits[bit / 64] |= (putValue >> putBit & 1) << (bit % 64); \
+} while (0)
+
+    PUT_BITS(1 << 6, 7);
+    for (int c = 0; c < 4; c++)
+    {
+        PUT_BITS(quantized[0][c], 7);
+        PUT_BITS(quantized[1][c], 7);
+    }
+    PUT_BITS(pBits[0], 1);
+    PUT_BITS(pBits[1], 1);
+    for (int i = 0; i < 16; i++) PUT_BITS(indices[i], i == 0 ? 3 : 4);
+
+#undef PUT_BITS
+
+    for (int i = 0; i < 16; i++) out[i] = bits[i / 8] >> (8 * (i % 8)) & 0xff;
+}
+
+static inline int clampByte(int value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// picks the ETC1 modifier table and per-texel indices for one half of the block around its base color, returning the error
+static int encodeEtcSubblock(const uint8_t texels[16][4], bool flip, int half, const int base[3], int *table, uint32_t *indices)
+{
+    static const int modifiers[8][4] = {
+        {  2,   8,  -2,   -8 }, {  5,  17,  -5,  -17 }, {  9,  29,  -9,  -29 }, { 13,  42, -13,  -42 },
+        { 18,  60, -18,  -60 }, { 24,  80, -24,  -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 },
+    };
+
+    int bestError = INT32_MAX;
+    for (int t = 0; t < 8; t++)
+    {
+        int      error = 0;
+        uint32_t bits  = 0;
+
+        for (int y = 0; y < 4; y++)
+        {
+            for (int x = 0; x < 4; x++)
+            {
+                if ((flip ? y : x) / 2 != half) continue;
+
+                const uint8_t *texel        = texels[y * 4 + x];
+                int            best         = 0;
+                int            bestDistance = INT32_MAX;
+                for (int m = 0; m < 4; m++)
+                {
+                    int distance = 0;
+                    for (int c = 0; c < 3; c++)
+                    {
+                        int difference = texel[c] - clampByte(base[c] + modifiers[t][m]);
+                        distance += difference * difference;
+                    }
+
+                    if (distance < bestDistance)
+                    {
+                        best         = m;
+                        bestDistance = distance;
+                    }
+                }
+
+                // texels are numbered down the columns, index MSBs in the upper half of the word
+                int k  = x * 4 + y;
+                bits  |= (uint32_t)(best >> 1) << (16 + k) | (uint32_t)(best & 1) << k;
+                error += bestDistance;
+            }
+        }
+
+        if (error < bestError)
+        {
+            bestError = error;
+            *table    = t;
+            *indices  = bits;
+        }
+    }
+
+    return bestError;
+}
+
+// ETC2 RGB, restricted to the ETC1 individual and differential modes: each half of the block gets its average color,
+// stored as a 5-bit base and 3-bit delta when the halves are close enough, as two 4-bit colors otherwise
+static void encodeEtc2ColorBlock(const uint8_t texels[16][4], uint8_t out[8])
+{
+    uint64_t bestBlock = 0;
+    int      bestError = INT32_MAX;
+
+    for (int flip = 0; flip < 2; flip++)
+    {
+        int average[2][3] = { { 0 } };
+        for (int y = 0; y < 4; y++)
+        {
+            for (int x = 0; x < 4; x++)
+            {
+                for (int c = 0; c < 3; c++) average[(flip ? y : x) / 2][c] += texels[y * 4 + x][c];
+            }
+        }
+
+        int  colors[2][3];
+        bool differential = true;
+        for (int c = 0; c < 3; c++)
+        {
+            colors[0][c] = (average[0][c] * 31 + 255 * 4) / (255 * 8);
+            colors[1][c] = (average[1][c] * 31 + 255 * 4) / (255 * 8);
+
+            int delta = colors[1][c] - colors[0][c];
+            if (delta < -4 || delta > 3) differential = false;
+        }
+
+        int bases[2][3];
+        for (int h = 0; h < 2; h++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                if (differential) bases[h][c] = colors[h][c] << 3 | colors[h][c] >> 2;
+                else
+                {
+                    colors[h][c] = (average[h][c] * 15 + 255 * 4) / (255 * 8);
+                    bases[h][c]  = colors[h][c] << 4 | colors[h][c];
+                }
+            }
+        }
+
+        int      tables[2];
+        uint32_t indices[2];
+        int      error = encodeEtcSubblock(texels, flip, 0, bases[0], &tables[0], &indices[0]) +
+                         encodeEtcSubblock(texels, flip, 1, bases[1], &tables[1], &indices[1]);
+        if (error >= bestError) continue;
+
+        uint64_t block = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            int shift = 59 - 8 * c;
+            if (differential) block |= (uint64_t)colors[0][c] << shift | (uint64_t)((colors[1][c] - colors[0][c]) & 7) << (shift - 3);
+            else block |= (uint64_t)colors[0][c] << (shift + 1) | (uint64_t)colors[1][c] << (shift - 3);
+        }
+
+        block |= (uint64_t)tables[0] << 37 | (uint64_t)tables[1] << 34 | (uint64_t)differential << 33 | (uint64_t)flip << 32;
+        block |= indices[0] | indices[1];
+
+        bestBlock = block;
+        bestError = error;
+    }
+
+    for (int i = 0; i < 8; i++) out[i] = bestBlock >> (56 - 8 * i) & 0xff;
+}
+
+// EAC alpha: the base sits in the middle of the block's alpha range and each table gets the multiplier that
+// stretches it over that range, tried one step either side
+static void encodeEacAlphaBlock(const uint8_t texels[16][4], uint8_t out[8])
+{
+    static const int modifiers[16][8] = {
+        { -3, -6,  -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 }, { -2, -5, -8, -13, 1, 4, 7, 12 },
+        { -2, -4,  -6, -13, 1, 3, 5, 12 }, { -3, -6,  -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+        { -4, -7,  -8, -11, 3, 6, 7, 10 }, { -3, -5,  -8, -11, 2, 4, 7, 10 }, { -2, -6, -8, -10, 1, 5, 7,  9 },
+        { -2, -5,  -8, -10, 1, 4, 7,  9 }, { -2, -4,  -8, -10, 1, 3, 7,  9 }, { -2, -5, -7, -10, 1, 4, 6,  9 },
+        { -3, -4,  -7, -10, 2, 3, 6,  9 }, { -1, -2,  -3, -10, 0, 1, 2,  9 }, { -4, -6, -8,  -9, 3, 5, 7,  8 },
+        { -3, -5,  -7,  -9, 2, 4, 6,  8 },
+    };
+
+    int minAlpha = 255, maxAlpha = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        if (texels[i][3] < minAlpha) minAlpha = texels[i][3];
+        if (texels[i][3] > maxAlpha) maxAlpha = texels[i][3];
+    }
+
+    int      base      = (minAlpha + maxAlpha + 1) / 2;
+    uint64_t bestBlock = 0;
+    int      bestError = INT32_MAX;
+
+    for (int t = 0; t < 16; t++)
+    {
+        int span   = modifiers[t][7] - modifiers[t][3];
+        int target = (maxAlpha - minAlpha + span - 1) / span;
+
+        for (int multiplier = target - 1; multiplier <= target + 1; multiplier++)
+        {
+            if (multiplier < 1 || multiplier > 15) continue;
+
+            uint64_t block = (uint64_t)base << 56 | (uint64_t)multiplier << 52 | (uint64_t)t << 48;
+            int      error = 0;
+
+            for (int y = 0; y < 4; y++)
+            {
+                for (int x = 0; x < 4; x++)
+                {
+                    int alpha        = texels[y * 4 + x][3];
+                    int best         = 0;
+                    int bestDistance = INT32_MAX;
+                    for (int m = 0; m < 8; m++)
+                    {
+                        int distance = abs(alpha - clampByte(base + modifiers[t][m] * multiplier));
+                        if (distance < bestDistance)
+                        {
+                            best         = m;
+                            bestDistance = distance;
+                        }
+                    }
+
+                    block |= (uint64_t)best << (45 - 3 * (x * 4 + y));
+                    error += bestDistance * bestDistance;
+                }
+            }
+
+            if (error < bestError)
+            {
+                bestBlock = block;
+                bestError = error;
+            }
+        }
+    }
+
+    for (int i = 0; i < 8; i++) out[i] = bestBlock >> (56 - 8 * i) & 0xff;
+}
+
+static void encodeLevel(const uint8_t *pixels, uint32_t width, uint32_t height, Target target, uint8_t *out)
+{
+    if (target == TARGET_RGBA8)
+    {
+        memcpy(out, pixels, (size_t)width * height * 4);
+        return;
+    }
+
+    for (uint32_t blockY = 0; blockY < height; blockY += 4)
+    {
+        for (uint32_t blockX = 0; blockX < width; blockX += 4)
+        {
+            // blocks hanging over the edge repeat the last row and column
+            uint8_t texels[16][4];
+            for (uint32_t y = 0; y < 4; y++)
+            {
+                for (uint32_t x = 0; x < 4; x++)
+                {
+                    uint32_t sourceX = blockX + x < width ? blockX + x : width - 1;
+                    uint32_t sourceY = blockY + y < height ? blockY + y : height - 1;
+                    memcpy(texels[y * 4 + x], &pixels[(sourceY * width + sourceX) * 4], 4);
+                }
+            }
+
+            switch (target)
+            {
+                case TARGET_BC7:
+                    encodeBc7Block(texels, out);
+                    out += 16;
+                    break;
+
+                case TARGET_ETC2_ALPHA:
+                    encodeEacAlphaBlock(texels, out);
+                    out += 8;
+                    // fallthrough
+                case TARGET_ETC2:
+                    encodeEtc2ColorBlock(texels, out);
+                    out += 8;
+                    break;
+
+                case TARGET_BC3:
+                    encodeAlphaBlock(texels, out);
+                    out += 8;
+                    // fallthrough
+                default:
+                    encodeColorBlock(texels, out);
+                    out += 8;
+                    break;
+            }
+        }
+    }
+}
+
+static VkFormat targetFormat(Target target, bool linear)
+{
+    switch (target)
+    {
+        case TARGET_BC1: return linear ? VK_FORMAT_BC1_RGB_UNORM_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+        case TARGET_BC3: return linear ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC3_SRGB_BLOCK;
+        case TARGET_BC7: return linear ? VK_FORMAT_BC7_UNORM_BLOCK : VK_FORMAT_BC7_SRGB_BLOCK;
+        case TARGET_ETC2: return linear ? VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK : VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK;
+        case TARGET_ETC2_ALPHA: return linear ? VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK : VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK;
+        default:         return linear ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB;
+    }
+}
+
+static void usage(const char *program)
+{
+    printf("usage: %s [options] <input> <output.ctex>\n", program);
+    printf("    --format <f>  bc1, bc3, bc7, etc2, etc2a or rgba8 (default: bc1 for opaque images, bc3 otherwise)\n");
+    printf("                  etc2 and etc2a target mobile GPUs without BC support, etc2a keeps an EAC alpha channel\n");
+    printf("    --linear      store non-color data, filtered and sampled without sRGB conversion\n");
+}
+
+int main(int argc, char **argv)
+{
+    Target      target     = TARGET_AUTO;
+    bool        linear     = false;
+    const char *inputPath  = NULL;
+    const char *outputPath = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            const char *value = argv[++i];
+            if (strcmp(value, "bc1") == 0) target = TARGET_BC1;
+            else if (strcmp(value, "bc3") == 0) target = TARGET_BC3;
+            else if (strcmp(value, "bc7") == 0) target = TARGET_BC7;
+            else if (strcmp(value, "etc2") == 0) target = TARGET_ETC2;
+            else if (strcmp(value, "etc2a") == 0) target = TARGET_ETC2_ALPHA;
+            else if (strcmp(value, "rgba8") == 0) target = TARGET_RGBA8;
+            else FATAL("unknown format: %s\n", value);
+        }
+        else if (strcmp(argv[i], "--linear") == 0) linear = true;
+        else if (strcmp(argv[i], "--help") == 0)
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        else if (inputPath == NULL) inputPath = argv[i];
+        else if (outputPath == NULL) outputPath = argv[i];
+        else
+        {
+            usage(argv[0]);
+            FATAL("unexpected argument: %s\n", argv[i]);
+        }
+    }
+
+    if (inputPath == NULL || outputPath == NULL)
+    {
+        usage(argv[0]);
+        FATAL("missing input or output path\n");
+    }
+
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load(inputPath, &width, &height, &channels, STBI_rgb_alpha);
+    if (pixels == NULL) FATAL("could not load %s: %s\n", inputPath, stbi_failure_reason());
+
+    if (target == TARGET_AUTO)
+    {
+        target = TARGET_BC1;
+        for (size_t i = 0; i < (size_t)width * height; i++)
+        {
+            if (pixels[i * 4 + 3] == 255) continue;
+
+            target = TARGET_BC3;
+            break;
+        }
+    }
+
+    VkFormat format = targetFormat(target, linear);
+
+    CookedTextureHeader header = { 0 };
+    header.magic               = COOKED_TEXTURE_MAGIC;
+    header.version             = COOKED_TEXTURE_VERSION;
+    header.format              = format;
+    header.width               = width;
+    header.height              = height;
+    header.mipLevels           = mipLevelCount(width, height);
+
+    CookedTextureLevel *levels = calloc(header.mipLevels, sizeof(CookedTextureLevel));
+    uint64_t            offset = ALIGN_UP(sizeof(header) + header.mipLevels * sizeof(CookedTextureLevel), COOKED_TEXTURE_ALIGNMENT);
+    for (uint32_t i = 0; i < header.mipLevels; i++)
+    {
+        levels[i].offset = offset;
+        levels[i].size   = textureLevelSize(format, mipExtent(width, i), mipExtent(height, i));
+        offset           = ALIGN_UP(offset + levels[i].size, COOKED_TEXTURE_ALIGNMENT);
+    }
+
+    uint8_t *file = calloc(offset, 1);
+    memcpy(file, &header, sizeof(header));
+    memcpy(file + sizeof(header), levels, header.mipLevels * sizeof(CookedTextureLevel));
+
+    uint64_t rawSize = 0;
+    uint8_t *level   = pixels;
+    for (uint32_t i = 0; i < header.mipLevels; i++)
+    {
+        uint32_t levelWidth  = mipExtent(width, i);
+        uint32_t levelHeight = mipExtent(height, i);
+        rawSize += (uint64_t)levelWidth * levelHeight * 4;
+
+        encodeLevel(level, levelWidth, levelHeight, target, file + levels[i].offset);
+
+        if (i + 1 == header.mipLevels) break;
+
+        uint8_t *next = malloc((size_t)mipExtent(width, i + 1) * mipExtent(height, i + 1) * 4);
+        downsampleRgba8(level, levelWidth, levelHeight, next, mipExtent(width, i + 1), mipExtent(height, i + 1), !linear);
+
+        if (level != pixels) free(level);
+        level = next;
+    }
+    if (level != pixels) free(level);
+
+    FILE *output = fopen(outputPath, "wb");
+    if (output == NULL) FATAL("could not open %s for writing\n", outputPath);
+    if (fwrite(file, offset, 1, output) != 1 || fclose(output) != 0) FATAL("could not write %s\n", outputPath);
+
+    INFO("cooked %s (%dx%d, %u mips) to %s: %llu KiB as RGBA8, %llu KiB cooked\n",
+         inputPath, width, height, header.mipLevels, outputPath, (unsigned long long)rawSize / 1024, (unsigned long long)offset / 1024);
+
+    free(file);
+    free(levels);
+    stbi_image_free(pixels);
+
+    return 0;
+}